@@ -3,7 +3,56 @@
 //
 
 #include "Process.h"
+#include "memory/frame_allocator.h"
+#include "memory/SlabCache.h"
+#include "syscall.h"
 
 namespace process {
     Process *activeProcess = nullptr;
-} // process
\ No newline at end of file
+
+    static memory::SlabCache<Process> process_cache;
+
+    Process* create() {
+        auto address_space = paging::create_address_space(*memory::frame_allocator);
+
+        auto process = process_cache.allocate();
+        ASSERT(process != nullptr, "Out of memory allocating a process");
+        new (process) Process(address_space, USER_HEAP_INITIAL_BREAK);
+
+        auto flags = paging::PageFlags{.writable = true, .user_accessible = true, .no_execute = true};
+        process->demand_regions.add(USER_HEAP_START, USER_HEAP_INITIAL_BREAK - USER_HEAP_START, flags);
+        process->demand_regions.add(USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_SIZE, flags);
+        return process;
+    }
+
+    uint64_t sbrk(Process* process, int64_t increment) {
+        auto old_break = process->heap_break;
+        auto new_break = old_break + static_cast<uint64_t>(increment);
+        if (new_break < USER_HEAP_START || new_break > USER_HEAP_START + USER_HEAP_SIZE
+            || (increment > 0 && new_break < old_break) || (increment < 0 && new_break > old_break)) {
+            return SBRK_FAILED;
+        }
+
+        if (increment < 0) {
+            // The heap window is demand paged, only the pages that were touched are mapped.
+            // Give back the frames of every page that is now entirely above the break.
+            auto& page_table = paging::ActivePageTable::instance();
+            auto first = memory::align_up(new_break, memory::PAGE_SIZE);
+            auto last = memory::align_up(old_break, memory::PAGE_SIZE);
+            for (auto address = first; address < last; address += memory::PAGE_SIZE) {
+                if (page_table.translate(address).has_value()) {
+                    page_table.unmap(paging::Page::containing_address(address), *memory::frame_allocator);
+                }
+            }
+        }
+
+        process->heap_break = new_break;
+        process->demand_regions.set_end(USER_HEAP_START, new_break);
+        return old_break;
+    }
+
+    void destroy(Process* process) {
+        paging::destroy_address_space(process->address_space, *memory::frame_allocator);
+        process_cache.deallocate(process);
+    }
+} // process
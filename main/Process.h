@@ -6,15 +6,48 @@
 #define MAIN_PROCESS_H
 
 #include "memory/memory.h"
-#include "memory/virtual/BlockAllocator.h"
+#include "paging/paging.h"
+#include "paging/fault.h"
+
+// The user stack grows down from USER_STACK_TOP and is demand paged like the heap
+constexpr VirtualAddress USER_STACK_TOP = 0xC0000000;
+constexpr uint64_t USER_STACK_SIZE = 2 * 1024 * 1024;  // 2MB stack
 
 
 class Process {
 public:
-    memory::BlockAllocator *heap = nullptr;
+    // end of the user heap, the allocator in user space moves it with SBRK
+    VirtualAddress heap_break;
+    // the process owns its user half, the kernel half is shared with every other process
+    paging::InactivePageTable address_space;
+    // heap and stack, backed by the page fault handler on first access. The heap region
+    // ends at the break.
+    paging::DemandRegions demand_regions;
+
+    explicit Process(paging::InactivePageTable address_space, VirtualAddress heap_break)
+        : heap_break(heap_break), address_space(address_space), demand_regions() {}
 };
 
 namespace process {
     extern Process *activeProcess;
+
+    /**
+     * Create a process with a fresh address space, an empty heap and a demand paged stack.
+     * The address space is not activated.
+     */
+    Process* create();
+
+    /**
+     * Move the heap break of the active process by `increment` bytes. Frames of pages
+     * that end up above the break are given back.
+     * @return The previous break, or SBRK_FAILED if the new break is outside the heap window
+     */
+    uint64_t sbrk(Process* process, int64_t increment);
+
+    /**
+     * Tear down a process that is no longer running: free its address space with all
+     * page tables and frames of the user half, then the process itself.
+     */
+    void destroy(Process* process);
 } // process
-#endif //MAIN_PROCESS_H
\ No newline at end of file
+#endif //MAIN_PROCESS_H
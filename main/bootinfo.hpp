@@ -50,6 +50,12 @@ struct Multiboot2TagString : public Multiboot2Tag {
     const char* get_string() const { return string; }
 } __attribute__((packed));
 
+struct Multiboot2TagModule : public Multiboot2Tag {
+    uint32_t mod_start;  // Physical start address of the module
+    uint32_t mod_end;    // Physical end address of the module (exclusive)
+    char cmdline[0];     // Flexible array member
+} __attribute__((packed));
+
 struct Multiboot2TagBasicMeminfo : public Multiboot2Tag {
     uint32_t mem_lower;
     uint32_t mem_upper;
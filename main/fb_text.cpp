@@ -1,5 +1,6 @@
 #include "fb_text.h"
 #include "font.h"
+#include "runtime/string.h"
 
 void fb_text_init(FbTextState* state, uint32_t* framebuffer, uint32_t width, uint32_t height) {
     state->framebuffer = framebuffer;
@@ -107,9 +108,7 @@ void fb_text_puts(FbTextState* state, const char* str) {
 
 void fb_text_clear(FbTextState* state) {
     // Fill entire framebuffer with background color
-    for (uint32_t i = 0; i < state->width * state->height; i++) {
-        state->framebuffer[i] = state->bg_color;
-    }
+    rnt::memset32_nt(state->framebuffer, state->bg_color, state->width * state->height);
 
     // Reset cursor
     state->cursor_x = 0;
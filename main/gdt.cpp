@@ -6,6 +6,7 @@
 #include "Process.h"
 #include "idt.hpp"  // For InterruptStackFrame
 #include "serial.h"
+#include "syscall.h"
 
 void GDT::init()
 {
@@ -94,31 +95,10 @@ void GDT::jump_to_ring3(void (*user_function)())
     // 0xB0000000 - 0xB0800000: 8MB heap (grows upward)
     // 0xBE000000 - 0xC0000000: 2MB stack (grows downward from 0xC0000000)
 
-    uint64_t USER_HEAP_START = 0xB0000000;
-    uint64_t USER_HEAP_SIZE = 8 * 1024 * 1024;   // 8MB heap
-    uint64_t USER_STACK_TOP = 0xC0000000;
-    uint64_t USER_STACK_SIZE = 2 * 1024 * 1024;  // 2MB stack
-
-    auto page_table = paging::ActivePageTable::instance();
-
     out << "User function addr: " << (void *)user_function << out.endl;
     out << "Setting up user heap: " << (void*)USER_HEAP_START << " - " << (void*)(USER_HEAP_START + USER_HEAP_SIZE) << out.endl;
     out << "Setting up user stack: " << (void*)(USER_STACK_TOP - USER_STACK_SIZE) << " - " << (void*)USER_STACK_TOP << out.endl;
 
-    // Map user heap with user_accessible and writable flags
-    auto heap_start_page = paging::Page::containing_address(USER_HEAP_START);
-    auto heap_end_page = paging::Page::containing_address(USER_HEAP_START + USER_HEAP_SIZE - 1);
-    for (auto i = heap_start_page.number; i <= heap_end_page.number; i++) {
-        page_table.map(paging::Page(i), paging::PageFlags{.writable = true, .user_accessible = true}, *memory::frame_allocator);
-    }
-
-    // Map user stack with user_accessible and writable flags
-    auto stack_top_page = paging::Page::containing_address(USER_STACK_TOP - USER_STACK_SIZE);
-    auto stack_bottom_page = paging::Page::containing_address(USER_STACK_TOP);
-    for (auto i = stack_bottom_page.number; i > stack_top_page.number; i--) {
-        page_table.map(paging::Page(i), paging::PageFlags{.writable = true, .user_accessible = true}, *memory::frame_allocator);
-    }
-
     // Map the user function code page as user-accessible
     // Note: This maps kernel code to be user-accessible, which is a security risk
     // In a real OS, you'd copy the code to user space instead
@@ -127,53 +107,14 @@ void GDT::jump_to_ring3(void (*user_function)())
 
     out << "Mapping user function page: " << (void*)user_func_page.start_addr() << out.endl;
 
-    // We need to set the user-accessible flag on all levels of the page table hierarchy
-    // for the user function's page. We do this by walking the page table via recursive mapping.
-    auto p4 = reinterpret_cast<paging::P4Table*>(paging::RECURSIVE_P4_ADDR);
-    uint16_t p4_index = (user_func_addr >> 39) & 0x1FF;
-    uint16_t p3_index = (user_func_addr >> 30) & 0x1FF;
-    uint16_t p2_index = (user_func_addr >> 21) & 0x1FF;
-    uint16_t p1_index = (user_func_addr >> 12) & 0x1FF;
-
-    // Set user-accessible on P4 entry
-    (*p4)[p4_index].set_user_accessible(true);
-
-    // Get P3 table and set user-accessible
-    auto p3 = p4->get_next_table(p4_index);
-    if (p3) {
-        (*p3)[p3_index].set_user_accessible(true);
-
-        // Get P2 table and set user-accessible
-        auto p2 = p3->get_next_table(p3_index);
-        if (p2) {
-            (*p2)[p2_index].set_user_accessible(true);
-
-            // Get P1 table and set user-accessible
-            auto p1 = p2->get_next_table(p2_index);
-            if (p1) {
-                (*p1)[p1_index].set_user_accessible(true);
-                out << "Set user-accessible flag on user function page" << out.endl;
-            }
-        }
-    }
-
-    // Flush TLB for the modified page
-    asm volatile("invlpg (%0)" :: "r"(user_func_addr) : "memory");
+    // Every process is created from the address space template, so the page only has to
+    // be made user accessible there once
+    paging::share_with_user(user_func_addr);
 
-    // Create and initialize the process with its heap
-    // Allocate Process object from kernel heap
-    auto process = reinterpret_cast<Process*>(memory::kernel_heap->allocate(sizeof(Process), alignof(Process)));
-
-    // Allocate BlockAllocator for the process heap from kernel heap
-    process->heap = reinterpret_cast<memory::BlockAllocator*>(
-        memory::kernel_heap->allocate(sizeof(memory::BlockAllocator), alignof(memory::BlockAllocator))
-    );
-
-    // Placement new to construct the BlockAllocator
-    new (process->heap) memory::BlockAllocator();
-
-    // Initialize the user heap with the memory range we just mapped
-    process->heap->init(USER_HEAP_START, USER_HEAP_SIZE);
+    // Create the process in its own address space. The kernel half, including the
+    // user-accessible function page marked above, is copied from the template.
+    auto process = process::create();
+    paging::switch_address_space(process->address_space);
 
     // Set as active process so syscalls can access it
     process::activeProcess = process;
@@ -206,35 +147,24 @@ void GDT::jump_to_ring3(void (*user_function)())
 
 void GDT::init_new_process(void (*entry_point)(), InterruptStackFrame* frame)
 {
-    uint64_t USER_HEAP_START = 0xB0000000;
-    uint64_t USER_HEAP_SIZE = 8 * 1024 * 1024;   // 8MB heap
-    uint64_t USER_STACK_TOP = 0xC0000000;
-
     SERIAL_INFO("[INIT_NEW_PROCESS] Replacing process with entry point at ");
     serial::write_hex(reinterpret_cast<uint64_t>(entry_point));
     serial::write_char('\n');
 
-    // 1. Destroy old process heap if it exists
-    if (process::activeProcess && process::activeProcess->heap) {
-        SERIAL_INFO("[INIT_NEW_PROCESS] Destroying old heap...");
-        memory::kernel_heap->deallocate(process::activeProcess->heap, sizeof(memory::BlockAllocator));
-    }
+    // 1. Build the new process in a fresh address space and switch to it
+    auto old_process = process::activeProcess;
+    auto new_process = process::create();
+    paging::switch_address_space(new_process->address_space);
 
-    // 2. Ensure we have a process object
-    if (!process::activeProcess) {
-        // First process - allocate structures
-        process::activeProcess = reinterpret_cast<Process*>(
-            memory::kernel_heap->allocate(sizeof(Process), alignof(Process))
-        );
-        process::activeProcess->heap = reinterpret_cast<memory::BlockAllocator*>(
-            memory::kernel_heap->allocate(sizeof(memory::BlockAllocator), alignof(memory::BlockAllocator))
-        );
-    }
+    // 2. Make it active, the old program's heap and stack are not visible anymore.
+    // The new program sets up its heap itself on its first malloc.
+    process::activeProcess = new_process;
 
-    // 3. Reinitialize heap with placement new
-    SERIAL_INFO("[INIT_NEW_PROCESS] Reinitializing heap...");
-    new (process::activeProcess->heap) memory::BlockAllocator();
-    process::activeProcess->heap->init(USER_HEAP_START, USER_HEAP_SIZE);
+    // 3. Tear down the old process, returning all of its frames and page tables
+    if (old_process) {
+        SERIAL_INFO("[INIT_NEW_PROCESS] Destroying old process...");
+        process::destroy(old_process);
+    }
 
     // 4. Set interrupt frame to jump to new program
     if (frame) {
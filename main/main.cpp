@@ -11,12 +11,15 @@
 #include "Process.h"
 #include "syscall.h"
 #include "memory/memory.h"
-#include "memory/virtual/BlockAllocator.h"
+#include "memory/virtual/KernelHeap.h"
+#include "memory/virtual/vmalloc.h"
 #include "paging/paging.h"
+#include "paging/fault.h"
 #include "x86/regs.h"
 #include "usermode.h"
 #include "serial.h"
 #include "fb_text.h"
+#include "runtime/string.h"
 
 static GDT gdt = GDT();
 static IDT idt = IDT();
@@ -24,8 +27,17 @@ static ChainedPICs pics = ChainedPICs();
 
 // Global framebuffer info (set in kernel_main, used in kernel_main_high)
 static const Multiboot2TagFramebuffer* g_framebuffer = nullptr;
+// Copy of the framebuffer tag, the boot information is reclaimed after boot
+static Multiboot2TagFramebuffer g_framebuffer_tag;
 static FbTextState g_fb_text_state;
 
+// VGA text buffer, 80x25 characters with an attribute byte each
+constexpr PhysicalAddress VGA_BUFFER = 0xb8000;
+constexpr size_t VGA_BUFFER_SIZE = 80 * 25 * 2;
+
+// Frames zeroed per wakeup while waiting for input, small enough to keep typing responsive
+constexpr uint64_t IDLE_ZERO_FRAMES = 8;
+
 // Program names for userspace (no function pointers to avoid low address issues)
 static const char* g_program_names[] = {
     "shell",
@@ -92,6 +104,12 @@ __attribute__((interrupt)) void df_handler(InterruptStackFrame *frame, uint64_t
 
 __attribute__((interrupt)) void pf_handler(InterruptStackFrame *frame, uint64_t code)
 {
+    // demand paged memory of the running process: map the page and restart the faulting instruction
+    auto process = process::activeProcess;
+    if (process != nullptr && paging::handle_page_fault(process->demand_regions, cr2::get_pfla(), code)) {
+        return;
+    }
+
     serial::write_string("[ERROR] Exception: Page Fault (error code: ");
     serial::write_dec(code);
     serial::write_string(")\n");
@@ -142,7 +160,10 @@ extern "C" uint64_t syscall_handler_inner(uint64_t syscall_number, uint64_t sysc
             // FIXME: This is bad
             while (!keyboard::hasChar()) {
                 interrupts_enable();
-                asm volatile("hlt");
+                // nothing else to do, zero frames ahead of page faults and new page tables
+                if (memory::frame_allocator->refill_zeroed(IDLE_ZERO_FRAMES) == 0) {
+                    asm volatile("hlt");
+                }
             }
             char c = keyboard::getChar();
             return static_cast<uint64_t>(c);  // Return the character read
@@ -154,26 +175,20 @@ extern "C" uint64_t syscall_handler_inner(uint64_t syscall_number, uint64_t sysc
             serial::write_string(reinterpret_cast<char *>(syscall_arg));
             return 0;  // Success
         }
-        case Syscall::MALLOC: {
-            serial::write_string("ALLOC\n");
-            auto tmp =  (uint64_t)process::activeProcess->heap->allocate(syscall_arg, 0);
-            serial::write_string("ALLOC ENDE\n");
-            return tmp;
+        case Syscall::SBRK: {
+            return process::sbrk(process::activeProcess, static_cast<int64_t>(syscall_arg));
         }
-        case Syscall::FREE: {
-            process::activeProcess->heap->deallocate((void*)syscall_arg, 0);
+        case Syscall::HEAP_STATS: {
+            SERIAL_INFO("Kernel heap:");
+            memory::kernel_heap->print_stats();
             return 0;
         }
         case Syscall::DRAW: {
             uint32_t width = g_framebuffer->framebuffer_width;
             uint32_t height = g_framebuffer->framebuffer_height;
-            uint32_t* framebuffer = g_framebuffer->get_buffer();
-            for (uint32_t y = 0; y < height; y++) {
-                for (uint32_t x = 0; x < width; x++) {
-                    uint32_t pixel_index = y * width + x;
-                    framebuffer[pixel_index] = ((uint32_t*)syscall_arg)[pixel_index];
-                }
-            }
+            uint32_t* framebuffer = g_fb_text_state.framebuffer;
+            // the frame is not read back, so stream it past the cache
+            rnt::memcpy_nt(framebuffer, reinterpret_cast<const uint32_t*>(syscall_arg), width * height * sizeof(uint32_t));
             return 0;
         }
         case Syscall::GET_SCREEN_WIDTH: {
@@ -304,6 +319,7 @@ extern "C" void kernel_main(void *mb_info_addr)
     // Initialize serial port for debugging (do this first!)
     serial::init();
     SERIAL_INFO("===== Kernel starting =====");
+    rnt::init_string();
 
     BootInfo* boot_info = static_cast<BootInfo *>(mb_info_addr);
 
@@ -315,7 +331,8 @@ extern "C" void kernel_main(void *mb_info_addr)
     // Store framebuffer info for later use
     auto fb = boot_info->get_framebuffer();
     if (fb.has_value()) {
-        g_framebuffer = fb.value();
+        g_framebuffer_tag = *fb.value();
+        g_framebuffer = &g_framebuffer_tag;
         SERIAL_INFO("Framebuffer available - will test after memory setup");
     }
 
@@ -360,11 +377,20 @@ extern "C" void kernel_main_high() {
     // This is necessary because placement new for BlockAllocator needs access to constructor code
     SERIAL_INFO("Initializing heap...");
     memory::init_heap();
+    memory::init_vmalloc();
+
+    // The VGA text buffer is still reached through the identity mapping
+    auto vga_buffer = memory::ioremap(VGA_BUFFER, VGA_BUFFER_SIZE, memory::Caching::WRITE_COMBINING);
+    ASSERT(vga_buffer != nullptr, "No room to map the VGA buffer");
+    vga::out().update_buffer_address(reinterpret_cast<uint64_t>(vga_buffer));
 
     // Now it's safe to unmap the lower half
     paging::unmap_lower_half();
     SERIAL_INFO("Lower half unmapped successfully!");
 
+    // The kernel table is final, every process starts as a copy of it from now on
+    paging::init_address_space_template(*memory::frame_allocator);
+
     // Initialize GDT, TSS + IST (once, at high addresses)
     SERIAL_INFO("Initializing GDT...");
     gdt.init();
@@ -407,10 +433,11 @@ extern "C" void kernel_main_high() {
     serial::write_hex((uint64_t)ptr);
     serial::write_char('\n');
     *ptr = 123;
-    memory::kernel_heap->deallocate(ptr, sizeof(int));
+    memory::kernel_heap->deallocate(ptr);
     serial::write_string("  value: ");
     serial::write_dec(*ptr);
     serial::write_char('\n');
+    memory::kernel_heap->print_stats();
     SERIAL_INFO("Heap memory allocation test complete!");
 
     SERIAL_INFO("We are still alive!");
@@ -430,27 +457,15 @@ extern "C" void kernel_main_high() {
         serial::write_dec(fb_size);
         serial::write_string(" bytes\n");
 
-        // Map framebuffer pages (identity map for simplicity)
-        auto page_table = paging::ActivePageTable::instance();
-        uint64_t fb_start = fb_addr & ~0xFFF;  // Align down to page boundary
-        uint64_t fb_end = (fb_addr + fb_size + 0xFFF) & ~0xFFF;  // Align up
+        // Map the framebuffer into the kernel half, so that every address space shares it.
+        // Write-combining lets the CPU burst whole lines instead of single uncached stores.
+        auto framebuffer = static_cast<uint32_t*>(memory::ioremap(fb_addr, fb_size, memory::Caching::WRITE_COMBINING));
+        ASSERT(framebuffer != nullptr, "No room to map the framebuffer");
 
-        serial::write_string("Mapping pages from ");
-        serial::write_hex(fb_start);
-        serial::write_string(" to ");
-        serial::write_hex(fb_end);
+        serial::write_string("Framebuffer mapped at ");
+        serial::write_hex(reinterpret_cast<uint64_t>(framebuffer));
         serial::write_char('\n');
 
-        for (uint64_t addr = fb_start; addr < fb_end; addr += 0x1000) {
-            auto frame = memory::Frame::containing_address(addr);
-            page_table.identity_map(frame, paging::PageFlags{.writable = true}, *memory::frame_allocator);
-        }
-
-        SERIAL_INFO("Framebuffer mapped! Drawing test pattern...");
-
-        // Now we can safely write to framebuffer
-        uint32_t* framebuffer = g_framebuffer->get_buffer();
-
         // Initialize framebuffer text state
         SERIAL_INFO("Initializing framebuffer text rendering...");
         fb_text_init(&g_fb_text_state, framebuffer, width, height);
@@ -460,6 +475,9 @@ extern "C" void kernel_main_high() {
         SERIAL_WARN("No framebuffer available");
     }
 
+    // Nothing reads the boot information or runs boot code anymore
+    memory::reclaim_boot_memory();
+
     // Jump to ring 3 usermode
     SERIAL_INFO("Jumping to ring 3...");
     gdt.jump_to_ring3(user_function);
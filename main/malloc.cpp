@@ -0,0 +1,75 @@
+#include "malloc.h"
+#include "syscall.h"
+#include "runtime/new.h"
+#include "memory/virtual/BlockAllocator.h"
+
+// Marks an initialized heap, the state page is zero on its first access
+constexpr uint64_t USER_HEAP_MAGIC = 0x6865'6170'7374'6174;
+
+/**
+ * Allocator state at USER_HEAP_START. It lives in the address space of the process,
+ * so every process has its own and it disappears with the process.
+ */
+struct UserHeap {
+    uint64_t magic;
+    memory::BlockAllocator allocator;
+};
+
+// Heap memory requested right away, the rest is added by sbrk when it runs out
+constexpr uint64_t USER_HEAP_INITIAL = 64 * 1024;
+
+constexpr uint64_t USER_HEAP_STATE_SIZE = (sizeof(UserHeap) + memory::PAGE_SIZE - 1) & ~(memory::PAGE_SIZE - 1);
+
+static size_t grow_user_heap(VirtualAddress heap_end, size_t min_size) {
+    auto size = memory::align_up(min_size, memory::PAGE_SIZE);
+    auto old_break = reinterpret_cast<uint64_t>(sbrk(static_cast<int64_t>(size)));
+    if (old_break == SBRK_FAILED) {
+        return 0;
+    }
+    ASSERT(old_break == heap_end, "Heap break was moved behind the allocator's back");
+    return size;
+}
+
+static void shrink_user_heap(VirtualAddress start, size_t size) {
+    auto old_break = reinterpret_cast<uint64_t>(sbrk(-static_cast<int64_t>(size)));
+    ASSERT(old_break != SBRK_FAILED && old_break == start + size, "Heap break was moved behind the allocator's back");
+}
+
+static memory::BlockAllocator& user_heap() {
+    auto heap = reinterpret_cast<UserHeap*>(USER_HEAP_START);
+    if (heap->magic == USER_HEAP_MAGIC) {
+        return heap->allocator;
+    }
+
+    // first allocation of the process: claim the rest of the state and the initial heap
+    auto old_break = reinterpret_cast<uint64_t>(sbrk(USER_HEAP_START + USER_HEAP_STATE_SIZE + USER_HEAP_INITIAL - USER_HEAP_INITIAL_BREAK));
+    ASSERT(old_break == USER_HEAP_INITIAL_BREAK, "Heap break was moved before the allocator was set up");
+
+    new (&heap->allocator) memory::BlockAllocator();
+    heap->allocator.init(USER_HEAP_START + USER_HEAP_STATE_SIZE, USER_HEAP_INITIAL,
+                         memory::HeapGrowth{grow_user_heap, shrink_user_heap},
+                         USER_HEAP_SIZE - USER_HEAP_STATE_SIZE);
+    heap->magic = USER_HEAP_MAGIC;
+    return heap->allocator;
+}
+
+void* malloc(uint64_t size) {
+    // record the caller of malloc in the heap profile, not malloc itself
+    return user_heap().allocate_for(size, 0, reinterpret_cast<uint64_t>(__builtin_return_address(0)));
+}
+
+void free(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    user_heap().deallocate(ptr);
+}
+
+static void write_stats(const char* str) {
+    write(const_cast<char*>(str));
+}
+
+void print_heap_stats() {
+    write(const_cast<char*>("Process heap:\n"));
+    user_heap().print_stats(memory::StatsWriter{write_stats});
+}
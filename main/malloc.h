@@ -0,0 +1,23 @@
+#ifndef MAIN_MALLOC_H
+#define MAIN_MALLOC_H
+#include <stdint.h>
+
+/**
+ * User-space heap allocator.
+ *
+ * The allocator runs entirely in the calling process: its state sits in the first page
+ * of the heap window and allocations are served from free lists in user memory. Only
+ * growing or shrinking the heap traps into the kernel, through sbrk().
+ */
+
+void* malloc(uint64_t size);
+
+void free(void* ptr);
+
+/**
+ * Print the statistics of the process heap (and its profile in HEAP_PROFILE builds)
+ * through the WRITE syscall
+ */
+void print_heap_stats();
+
+#endif //MAIN_MALLOC_H
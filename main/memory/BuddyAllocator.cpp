@@ -0,0 +1,189 @@
+#include "BuddyAllocator.h"
+#include "frame_allocator.h"
+#include "panic.h"
+
+namespace memory {
+
+    template<uint64_t FrameCount>
+    BuddyAllocator<FrameCount>::BuddyAllocator(uint64_t base_frame)
+        : base_frame(base_frame)
+        , free_frames_(0)
+    {
+        for (uint8_t order = 0; order <= BUDDY_MAX_ORDER; order++) {
+            free_blocks[order] = 0;
+            search_hint[order] = 0;
+        }
+        for (uint64_t i = 0; i < TOTAL_WORDS; i++) {
+            bitmap[i] = 0;
+        }
+    }
+
+    template<uint64_t FrameCount>
+    bool BuddyAllocator<FrameCount>::test(uint8_t order, uint64_t index) const {
+        return bitmap[offset_of(order) + index / 64] & (1ULL << (index % 64));
+    }
+
+    template<uint64_t FrameCount>
+    void BuddyAllocator<FrameCount>::set(uint8_t order, uint64_t index) {
+        bitmap[offset_of(order) + index / 64] |= 1ULL << (index % 64);
+        free_blocks[order]++;
+        if (index / 64 < search_hint[order]) {
+            search_hint[order] = index / 64;
+        }
+    }
+
+    template<uint64_t FrameCount>
+    void BuddyAllocator<FrameCount>::clear(uint8_t order, uint64_t index) {
+        bitmap[offset_of(order) + index / 64] &= ~(1ULL << (index % 64));
+        free_blocks[order]--;
+    }
+
+    template<uint64_t FrameCount>
+    rnt::Optional<uint64_t> BuddyAllocator<FrameCount>::find_free(uint8_t order, uint64_t limit) {
+        if (free_blocks[order] == 0) {
+            return {};
+        }
+        const uint64_t* words = &bitmap[offset_of(order)];
+        for (uint64_t w = search_hint[order]; w < words_at(order); w++) {
+            if (words[w] != 0) {
+                search_hint[order] = w;
+                uint64_t index = w * 64 + __builtin_ctzll(words[w]);
+                // this is the lowest free block, nothing above it can satisfy the limit either
+                if (index >= limit) {
+                    return {};
+                }
+                return index;
+            }
+        }
+        PANIC("Buddy free count out of sync with bitmap");
+    }
+
+    template<uint64_t FrameCount>
+    void BuddyAllocator<FrameCount>::add_range(Frame start, uint64_t count) {
+        uint64_t first = start.number < base_frame ? base_frame : start.number;
+        uint64_t end = start.number + count;
+        if (end > base_frame + FrameCount) {
+            end = base_frame + FrameCount;
+        }
+
+        // hand out the range as the largest naturally aligned blocks that fit
+        uint64_t frame = first;
+        while (frame < end) {
+            uint8_t order = BUDDY_MAX_ORDER;
+            while (order > 0 && (((frame - base_frame) & ((1ULL << order) - 1)) != 0 || frame + (1ULL << order) > end)) {
+                order--;
+            }
+            deallocate(Frame(frame), order);
+            frame += 1ULL << order;
+        }
+    }
+
+    template<uint64_t FrameCount>
+    rnt::Optional<Frame> BuddyAllocator<FrameCount>::allocate(uint8_t order, uint64_t limit_frame) {
+        ASSERT(order <= BUDDY_MAX_ORDER, "Buddy order too large");
+        // nothing beyond the covered range can be handed out, and a larger limit
+        // (UINT64_MAX by default) would overflow the rounding below
+        if (limit_frame > base_frame + FrameCount) {
+            limit_frame = base_frame + FrameCount;
+        }
+        if (limit_frame < base_frame + (1ULL << order)) {
+            return {};
+        }
+        // the lower 2^order frames of a block are kept, so only its start is bounded
+        uint64_t limit = (limit_frame - base_frame - (1ULL << order)) + 1;
+
+        // find the smallest free block that is big enough
+        uint8_t current = order;
+        rnt::Optional<uint64_t> found;
+        for (; current <= BUDDY_MAX_ORDER; current++) {
+            found = find_free(current, (limit + (1ULL << current) - 1) >> current);
+            if (found.has_value()) {
+                break;
+            }
+        }
+        if (found.is_empty()) {
+            return {};
+        }
+
+        auto index = found.value();
+        clear(current, index);
+
+        // split it down, keeping the lower half and freeing the upper buddy each time
+        while (current > order) {
+            current--;
+            index *= 2;
+            set(current, index + 1);
+        }
+
+        free_frames_ -= 1ULL << order;
+        return Frame(base_frame + (index << order));
+    }
+
+    template<uint64_t FrameCount>
+    rnt::Optional<Frame> BuddyAllocator<FrameCount>::allocate_run(uint64_t count, uint64_t align_frames, uint64_t limit_frame) {
+        constexpr uint64_t BLOCK = 1ULL << BUDDY_MAX_ORDER;
+        uint64_t blocks = (count + BLOCK - 1) / BLOCK;
+        uint64_t top_blocks = FrameCount >> BUDDY_MAX_ORDER;
+        if (limit_frame <= base_frame) {
+            return {};
+        }
+        uint64_t limit = (limit_frame - base_frame) / BLOCK;
+        if (limit > top_blocks) {
+            limit = top_blocks;
+        }
+        if (free_blocks[BUDDY_MAX_ORDER] < blocks) {
+            return {};
+        }
+
+        // scan for `blocks` neighbouring free blocks of the largest order, starting at an aligned one
+        for (uint64_t start = 0; start + blocks <= limit; start++) {
+            if (((base_frame + start * BLOCK) & (align_frames - 1)) != 0) {
+                continue;
+            }
+            uint64_t length = 0;
+            while (length < blocks && test(BUDDY_MAX_ORDER, start + length)) {
+                length++;
+            }
+            if (length < blocks) {
+                continue;
+            }
+
+            for (uint64_t i = 0; i < blocks; i++) {
+                clear(BUDDY_MAX_ORDER, start + i);
+            }
+            free_frames_ -= blocks * BLOCK;
+            auto first = Frame(base_frame + start * BLOCK);
+            // hand back the frames behind the requested count
+            add_range(Frame(first.number + count), blocks * BLOCK - count);
+            return first;
+        }
+        return {};
+    }
+
+    template<uint64_t FrameCount>
+    void BuddyAllocator<FrameCount>::deallocate(Frame frame, uint8_t order) {
+        ASSERT(order <= BUDDY_MAX_ORDER, "Buddy order too large");
+        ASSERT(contains(frame), "Frame not managed by this buddy allocator");
+
+        uint64_t relative = frame.number - base_frame;
+        ASSERT((relative & ((1ULL << order) - 1)) == 0, "Block not aligned to its order");
+
+        free_frames_ += 1ULL << order;
+        uint64_t index = relative >> order;
+        ASSERT(!test(order, index), "Block was already deallocated");
+
+        // merge with the buddy as long as it is free as a whole
+        while (order < BUDDY_MAX_ORDER && test(order, index ^ 1)) {
+            clear(order, index ^ 1);
+            index >>= 1;
+            order++;
+        }
+        set(order, index);
+    }
+
+    // Explicit template instantiations for concrete zone sizes
+    template class BuddyAllocator<AreaFrameAllocator::DMA_FRAMES>;
+    template class BuddyAllocator<AreaFrameAllocator::DMA32_FRAMES>;
+    template class BuddyAllocator<AreaFrameAllocator::NORMAL_FRAMES>;
+
+}
@@ -0,0 +1,99 @@
+#ifndef MAIN_BUDDYALLOCATOR_H
+#define MAIN_BUDDYALLOCATOR_H
+
+#include <stdint.h>
+#include "frame.h"
+#include "runtime/optional.h"
+
+namespace memory {
+
+    // Largest block handed out by the buddy allocator: 2^10 frames = 4 MiB
+    constexpr uint8_t BUDDY_MAX_ORDER = 10;
+
+    /**
+     * Binary buddy allocator for physical frames.
+     *
+     * Free blocks are tracked in one bitmap per order (bit set = block is free at exactly
+     * that order), so all metadata lives inside the object and its size is fixed by
+     * FrameCount. Nothing is ever written into the managed frames themselves, which means
+     * the allocator works before any of physical memory is mapped.
+     *
+     * Freeing merges a block with its buddy as long as the buddy is free, which is
+     * O(BUDDY_MAX_ORDER). Allocation splits the smallest large-enough free block.
+     *
+     * @tparam FrameCount Number of frames covered, starting at the base frame
+     */
+    template<uint64_t FrameCount>
+    class BuddyAllocator {
+        static_assert(FrameCount % (1ULL << BUDDY_MAX_ORDER) == 0, "FrameCount must be a multiple of the largest block");
+
+        static constexpr uint64_t words_at(uint8_t order) {
+            return ((FrameCount >> order) + 63) / 64;
+        }
+
+        static constexpr uint64_t offset_of(uint8_t order) {
+            uint64_t offset = 0;
+            for (uint8_t o = 0; o < order; o++) {
+                offset += words_at(o);
+            }
+            return offset;
+        }
+
+        static constexpr uint64_t TOTAL_WORDS = offset_of(BUDDY_MAX_ORDER + 1);
+
+        uint64_t base_frame;
+        uint64_t free_frames_;
+        uint64_t free_blocks[BUDDY_MAX_ORDER + 1];
+        // lowest bitmap word of each order that may contain a free block
+        uint64_t search_hint[BUDDY_MAX_ORDER + 1];
+        uint64_t bitmap[TOTAL_WORDS];
+
+        bool test(uint8_t order, uint64_t index) const;
+        void set(uint8_t order, uint64_t index);
+        void clear(uint8_t order, uint64_t index);
+        rnt::Optional<uint64_t> find_free(uint8_t order, uint64_t limit);
+
+    public:
+        /**
+         * Create an empty allocator (every frame is considered in use)
+         * @param base_frame First frame number covered by this allocator
+         */
+        explicit BuddyAllocator(uint64_t base_frame = 0);
+
+        /**
+         * Hand a run of free frames to the allocator.
+         * Frames outside the covered range are ignored.
+         */
+        void add_range(Frame start, uint64_t count);
+
+        /**
+         * Allocate 2^order physically contiguous frames, aligned to their size
+         * @param limit_frame The block must end at or below this frame number
+         */
+        rnt::Optional<Frame> allocate(uint8_t order, uint64_t limit_frame = UINT64_MAX);
+
+        /**
+         * Allocate a run of frames that is larger than the largest block by
+         * searching for neighbouring free blocks of the largest order.
+         * Frames beyond count are handed back right away.
+         * @param align_frames Alignment of the first frame, in frames (power of 2)
+         * @param limit_frame The run must end at or below this frame number
+         */
+        rnt::Optional<Frame> allocate_run(uint64_t count, uint64_t align_frames, uint64_t limit_frame);
+
+        /**
+         * Return a block previously obtained from allocate() with the same order
+         */
+        void deallocate(Frame frame, uint8_t order);
+
+        bool contains(Frame frame) const {
+            return frame.number >= base_frame && frame.number < base_frame + FrameCount;
+        }
+
+        uint64_t base() const { return base_frame; }
+        uint64_t free_frames() const { return free_frames_; }
+    };
+
+}
+
+#endif //MAIN_BUDDYALLOCATOR_H
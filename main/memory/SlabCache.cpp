@@ -0,0 +1,139 @@
+#include "SlabCache.h"
+#include "frame_allocator.h"
+#include "memory.h"
+#include "paging/physmap.h"
+#include "panic.h"
+#include "Process.h"
+
+namespace memory {
+
+    template<typename T>
+    void SlabCache<T>::push(Slab *&list, Slab *slab) {
+        slab->prev = nullptr;
+        slab->next = list;
+        if (list) {
+            list->prev = slab;
+        }
+        list = slab;
+    }
+
+    template<typename T>
+    void SlabCache<T>::remove(Slab *&list, Slab *slab) {
+        if (slab->prev) {
+            slab->prev->next = slab->next;
+        } else {
+            list = slab->next;
+        }
+        if (slab->next) {
+            slab->next->prev = slab->prev;
+        }
+        slab->next = nullptr;
+        slab->prev = nullptr;
+    }
+
+    template<typename T>
+    T *SlabCache<T>::object_at(Slab *slab, uint64_t index) {
+        return reinterpret_cast<T*>(reinterpret_cast<uint8_t*>(slab) + HEADER_SIZE + index * sizeof(T));
+    }
+
+    template<typename T>
+    typename SlabCache<T>::Slab *SlabCache<T>::grow() {
+        auto frame = frame_allocator->allocate_frame();
+        if (frame.is_empty()) {
+            return nullptr;
+        }
+
+        auto slab = paging::phys_to_virt<Slab>(frame.value().start_address());
+        slab->next = nullptr;
+        slab->prev = nullptr;
+        slab->in_use = 0;
+        for (uint64_t w = 0; w < BITMAP_WORDS; w++) {
+            auto remaining = OBJECTS_PER_SLAB - w * 64;
+            slab->free_map[w] = remaining >= 64 ? UINT64_MAX : (1ULL << remaining) - 1;
+        }
+        if (constructor) {
+            for (uint64_t i = 0; i < OBJECTS_PER_SLAB; i++) {
+                constructor(object_at(slab, i));
+            }
+        }
+
+        push(empty, slab);
+        stats_.slabs++;
+        stats_.empty_slabs++;
+        return slab;
+    }
+
+    template<typename T>
+    T *SlabCache<T>::allocate() {
+        auto slab = partial;
+        if (slab == nullptr) {
+            slab = empty ? empty : grow();
+            if (slab == nullptr) {
+                return nullptr;
+            }
+            // the slab moves from the empty to the partial list
+            remove(empty, slab);
+            push(partial, slab);
+            stats_.empty_slabs--;
+        }
+
+        uint64_t w = 0;
+        while (slab->free_map[w] == 0) {
+            w++;
+        }
+        auto bit = __builtin_ctzll(slab->free_map[w]);
+        slab->free_map[w] &= ~(1ULL << bit);
+        slab->in_use++;
+        if (slab->in_use == OBJECTS_PER_SLAB) {
+            remove(partial, slab);
+        }
+
+        stats_.objects_in_use++;
+        stats_.allocations++;
+        return object_at(slab, w * 64 + bit);
+    }
+
+    template<typename T>
+    void SlabCache<T>::deallocate(T *object) {
+        auto address = reinterpret_cast<uint64_t>(object);
+        auto slab = reinterpret_cast<Slab*>(address & ~(PAGE_SIZE - 1));
+        auto offset = address - reinterpret_cast<uint64_t>(slab) - HEADER_SIZE;
+        ASSERT(offset % sizeof(T) == 0 && offset / sizeof(T) < OBJECTS_PER_SLAB, "Object does not belong to a slab");
+
+        auto index = offset / sizeof(T);
+        auto mask = 1ULL << (index % 64);
+        ASSERT((slab->free_map[index / 64] & mask) == 0, "Object has already been freed");
+        slab->free_map[index / 64] |= mask;
+
+        // a full slab is not on any list
+        if (slab->in_use == OBJECTS_PER_SLAB) {
+            push(partial, slab);
+        }
+        slab->in_use--;
+        if (slab->in_use == 0) {
+            remove(partial, slab);
+            push(empty, slab);
+            stats_.empty_slabs++;
+        }
+
+        stats_.objects_in_use--;
+        stats_.frees++;
+    }
+
+    template<typename T>
+    uint64_t SlabCache<T>::reap() {
+        uint64_t freed = 0;
+        while (empty) {
+            auto slab = empty;
+            remove(empty, slab);
+            frame_allocator->deallocate_frame(Frame::containing_address(paging::virt_to_phys(slab)));
+            freed++;
+        }
+        stats_.slabs -= freed;
+        stats_.empty_slabs -= freed;
+        return freed;
+    }
+
+    // Explicit template instantiations
+    template class SlabCache<Process>;
+}
@@ -0,0 +1,96 @@
+#ifndef MAIN_SLABCACHE_H
+#define MAIN_SLABCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "constants.h"
+
+namespace memory {
+
+    struct SlabStats {
+        uint64_t slabs;          // frames held by the cache
+        uint64_t empty_slabs;    // slabs without a used object, given back by reap()
+        uint64_t objects_in_use;
+        uint64_t allocations;    // total number of allocate() calls that succeeded
+        uint64_t frees;          // total number of deallocate() calls
+    };
+
+    /**
+     * Object cache for one kernel type.
+     *
+     * Every slab is a single frame, reached through the physmap, with a header followed
+     * by as many objects as fit. A bitmap in the header tracks the free objects, so an
+     * object is found in a few bit scans and freeing only needs the object address: its
+     * slab is the page it lives in. Objects are packed at their natural alignment without
+     * per-object headers.
+     *
+     * Slabs with free objects are kept on a partial list, slabs without used objects on
+     * an empty list until reap() returns them to the frame allocator. Full slabs are not
+     * linked anywhere.
+     *
+     * If a constructor is given, it runs once for every object when its slab is created.
+     * Objects are expected back in their constructed state, so allocate() hands them out
+     * ready to use.
+     *
+     * The constructor is constexpr, so caches can be globals without static initializers.
+     *
+     * @tparam T Object type, allocate() returns raw (or constructor cached) storage for it
+     */
+    template<typename T>
+    class SlabCache {
+        static_assert(alignof(T) <= PAGE_SIZE, "Objects cannot be aligned beyond a page");
+
+        static constexpr uint64_t MAX_OBJECTS = PAGE_SIZE / sizeof(T);
+        static constexpr uint64_t BITMAP_WORDS = (MAX_OBJECTS + 63) / 64;
+
+        struct Slab {
+            Slab* next;
+            Slab* prev;
+            uint64_t in_use;
+            // bit set = object is free
+            uint64_t free_map[BITMAP_WORDS];
+        };
+
+        static constexpr uint64_t HEADER_SIZE = (sizeof(Slab) + alignof(T) - 1) & ~(alignof(T) - 1);
+        static_assert(HEADER_SIZE + sizeof(T) <= PAGE_SIZE, "Object does not fit into a slab");
+
+    public:
+        static constexpr uint64_t OBJECTS_PER_SLAB = (PAGE_SIZE - HEADER_SIZE) / sizeof(T);
+
+    private:
+        void (*constructor)(T*);
+        Slab* partial;
+        Slab* empty;
+        SlabStats stats_;
+
+        Slab *grow();
+        T *object_at(Slab *slab, uint64_t index);
+        static void push(Slab *&list, Slab *slab);
+        static void remove(Slab *&list, Slab *slab);
+
+    public:
+        constexpr explicit SlabCache(void (*constructor)(T*) = nullptr)
+            : constructor(constructor), partial(nullptr), empty(nullptr), stats_{0, 0, 0, 0, 0} {}
+
+        /**
+         * Take an object from the cache, nullptr if a new slab is needed and no frame is left
+         */
+        T *allocate();
+
+        /**
+         * Return an object to the slab it was allocated from
+         */
+        void deallocate(T *object);
+
+        /**
+         * Give all empty slabs back to the frame allocator
+         * @return The number of frames freed
+         */
+        uint64_t reap();
+
+        const SlabStats &stats() const { return stats_; }
+    };
+
+}
+
+#endif //MAIN_SLABCACHE_H
@@ -0,0 +1,176 @@
+#include "UsableMemory.h"
+#include "bootinfo.hpp"
+#include "panic.h"
+
+// Linker symbols, see linker.ld
+extern "C" uint8_t _boot_start[];
+extern "C" uint8_t p4_table[];
+
+namespace memory {
+
+    void UsableMemory::insert_at(uint16_t index, Extent extent) {
+        ASSERT(count < MAX_EXTENTS, "Too many usable memory extents");
+        for (uint16_t i = count; i > index; i--) {
+            extents[i] = extents[i - 1];
+        }
+        extents[index] = extent;
+        count++;
+    }
+
+    void UsableMemory::remove_at(uint16_t index, uint16_t n) {
+        for (uint16_t i = index; i + n < count; i++) {
+            extents[i] = extents[i + n];
+        }
+        count -= n;
+    }
+
+    void UsableMemory::add(PhysicalAddress start, PhysicalAddress end) {
+        start = (start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        end &= ~(PAGE_SIZE - 1);
+        if (start >= end) {
+            return;
+        }
+
+        // the first extent that ends at or behind the start touches or follows the new range
+        uint16_t first = 0;
+        while (first < count && extents[first].end < start) {
+            first++;
+        }
+        // merge every extent that touches the new range
+        uint16_t last = first;
+        while (last < count && extents[last].start <= end) {
+            if (extents[last].start < start) start = extents[last].start;
+            if (extents[last].end > end) end = extents[last].end;
+            last++;
+        }
+
+        remove_at(first, last - first);
+        insert_at(first, Extent{start, end});
+    }
+
+    void UsableMemory::reserve(PhysicalAddress start, PhysicalAddress end) {
+        start &= ~(PAGE_SIZE - 1);
+        end = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        if (start >= end) {
+            return;
+        }
+
+        uint16_t i = 0;
+        while (i < count && extents[i].start < end) {
+            auto& extent = extents[i];
+            if (extent.end <= start) {
+                i++;
+                continue;
+            }
+
+            auto left = Extent{extent.start, start};
+            auto right = Extent{end, extent.end};
+            if (left.start < left.end && right.start < right.end) {
+                // the reserved range splits the extent
+                extent = left;
+                insert_at(i + 1, right);
+                return;
+            }
+            if (left.start < left.end) {
+                extent = left;
+                i++;
+            } else if (right.start < right.end) {
+                extent = right;
+                return;
+            } else {
+                remove_at(i, 1);
+            }
+        }
+    }
+
+    uint64_t UsableMemory::frames() const {
+        uint64_t frames = 0;
+        for (auto& extent : *this) {
+            frames += extent.frames();
+        }
+        return frames;
+    }
+
+    /**
+     * Call `visit(start, end, kind)` for every range that is in use at boot
+     */
+    template<typename Visitor>
+    static void for_each_boot_range(const BootInfo& boot_info, Visitor visit) {
+        visit(0, LOW_MEMORY_END, BootRange::IN_USE);
+
+        // The kernel image, the ELF sections carry physical addresses. The boot loader also
+        // loads sections that are not allocated (symbol and string tables, which section
+        // names are read from), those without an address were not loaded.
+        auto elf_sections = boot_info.get_elf_sections();
+        if (elf_sections.has_value()) {
+            auto elf = elf_sections.value();
+            for (auto section = elf->sections_begin(); section != elf->sections_end(); ++section) {
+                if (section->addr == 0 || section->size == 0) {
+                    continue;
+                }
+                auto kind = BootRange::IN_USE;
+                if (!section->is_allocated()) {
+                    kind = BootRange::PHYSMAP;
+                } else if (section->addr == reinterpret_cast<PhysicalAddress>(_boot_start)
+                        || section->addr == reinterpret_cast<PhysicalAddress>(p4_table)) {
+                    kind = BootRange::KERNEL_HALF;
+                }
+                visit(section->addr, section->addr + section->size, kind);
+            }
+        }
+
+        auto multiboot_start = reinterpret_cast<PhysicalAddress>(&boot_info);
+        visit(multiboot_start, multiboot_start + boot_info.get_total_size(), BootRange::KERNEL_HALF);
+
+        for (auto tag = boot_info.tags_begin(); tag->type != Multiboot2Tag::END; tag = tag->next()) {
+            if (tag->type == Multiboot2Tag::MODULE) {
+                auto module = static_cast<const Multiboot2TagModule*>(tag);
+                visit(module->mod_start, module->mod_end, BootRange::IN_USE);
+            }
+        }
+
+        auto framebuffer = boot_info.get_framebuffer();
+        if (framebuffer.has_value()) {
+            auto fb = framebuffer.value();
+            visit(fb->framebuffer_addr, fb->framebuffer_addr + static_cast<uint64_t>(fb->framebuffer_pitch) * fb->framebuffer_height,
+                  BootRange::IN_USE);
+        }
+
+        // nothing reads the ACPI tables yet
+        auto mmap = boot_info.get_memory_map();
+        for (auto area = mmap->entries_begin(); area != mmap->entries_end(); ++area) {
+            if (area->is_acpi_reclaimable()) {
+                visit(area->addr, area->addr + area->len, BootRange::PHYSMAP);
+            }
+        }
+    }
+
+    void UsableMemory::from_boot_info(const BootInfo& boot_info, UsableMemory& usable) {
+        auto mmap = boot_info.get_memory_map();
+        for (auto area = mmap->entries_begin(); area != mmap->entries_end(); ++area) {
+            if (area->is_available()) {
+                usable.add(area->addr, area->addr + area->len);
+            }
+        }
+
+        for_each_boot_range(boot_info, [&usable](PhysicalAddress start, PhysicalAddress end, BootRange) {
+            usable.reserve(start, end);
+        });
+    }
+
+    void UsableMemory::boot_only(const BootInfo& boot_info, BootRange kind, UsableMemory& reclaimable) {
+        ASSERT(kind != BootRange::IN_USE, "Memory in use cannot be reclaimed");
+        for_each_boot_range(boot_info, [&reclaimable, kind](PhysicalAddress start, PhysicalAddress end, BootRange range) {
+            if (range == kind) {
+                reclaimable.add(start, end);
+            }
+        });
+        // pages shared with other ranges stay reserved
+        for_each_boot_range(boot_info, [&reclaimable, kind](PhysicalAddress start, PhysicalAddress end, BootRange range) {
+            if (range != kind) {
+                reclaimable.reserve(start, end);
+            }
+        });
+    }
+
+}
@@ -0,0 +1,90 @@
+#ifndef MAIN_USABLEMEMORY_H
+#define MAIN_USABLEMEMORY_H
+
+#include <stdint.h>
+#include "frame.h"
+
+struct BootInfo;
+
+namespace memory {
+
+    // Upper bound for the extents of usable memory, the firmware map rarely has more than a dozen
+    constexpr uint16_t MAX_EXTENTS = 64;
+
+    // Real mode memory (IVT, BIOS data area, EBDA) is never handed out, which also keeps frame 0 unused
+    constexpr PhysicalAddress LOW_MEMORY_END = 0x100000;
+
+    /**
+     * What happens to a range that is in use at boot
+     */
+    enum class BootRange : uint8_t {
+        IN_USE,       // stays reserved
+        KERNEL_HALF,  // only needed during boot, also mapped at KERNEL_OFFSET
+        PHYSMAP,      // only needed during boot, reachable through the physmap only
+    };
+
+    /**
+     * Page aligned physical range [start, end)
+     */
+    struct Extent {
+        PhysicalAddress start;
+        PhysicalAddress end;
+
+        uint64_t frames() const {
+            return (end - start) / PAGE_SIZE;
+        }
+    };
+
+    /**
+     * Usable physical memory as a sorted list of disjoint, coalesced extents.
+     *
+     * Built once at boot from the multiboot memory map, with every range that is in use
+     * subtracted, so the frame allocator can take whole extents instead of checking
+     * every frame on its own.
+     */
+    class UsableMemory {
+        Extent extents[MAX_EXTENTS];
+        uint16_t count;
+
+        void insert_at(uint16_t index, Extent extent);
+        void remove_at(uint16_t index, uint16_t n);
+
+    public:
+        UsableMemory(): extents{}, count(0) {}
+
+        /**
+         * Available areas of the memory map minus low memory, all loaded ELF sections of the
+         * kernel, the boot information, boot modules and the framebuffer
+         */
+        static void from_boot_info(const BootInfo& boot_info, UsableMemory& usable);
+
+        /**
+         * Ranges of one kind of boot-only memory, minus every range that is in use or of
+         * the other kind, so no frame is given back twice:
+         * - KERNEL_HALF: the .boot and .pagetables sections of the kernel and the boot information
+         * - PHYSMAP: ACPI reclaimable areas and ELF sections the boot loader loaded without
+         *   allocating them (symbol and string tables, debug information)
+         * Must be collected before the boot information is given up.
+         */
+        static void boot_only(const BootInfo& boot_info, BootRange kind, UsableMemory& reclaimable);
+
+        /**
+         * Add a usable range, shrunk to whole frames and merged with its neighbours
+         */
+        void add(PhysicalAddress start, PhysicalAddress end);
+
+        /**
+         * Remove a range that is in use, grown to whole frames
+         */
+        void reserve(PhysicalAddress start, PhysicalAddress end);
+
+        const Extent* begin() const { return extents; }
+        const Extent* end() const { return extents + count; }
+        uint16_t size() const { return count; }
+
+        uint64_t frames() const;
+    };
+
+}
+
+#endif //MAIN_USABLEMEMORY_H
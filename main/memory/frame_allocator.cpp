@@ -3,200 +3,254 @@
 //
 
 #include "frame_allocator.h"
-#include "AreaFrameIterator.h"
 #include "vga.hpp"
 #include "../bootinfo.hpp"
-#include "virtual/BlockAllocator.h"
+#include "paging/physmap.h"
+#include "runtime/string.h"
 
 namespace memory {
 
-    extern BlockAllocator* kernel_heap;
+    AreaFrameAllocator::AreaFrameAllocator(const UsableMemory& usable)
+        : magazines{}
+        , lock()
+        , zeroed_head(0)
+        , zeroed_count(0)
+        , dma_zone(0)
+        , dma32_zone(DMA_FRAMES)
+        , normal_zone(DMA_FRAMES + DMA32_FRAMES)
+    {
+        for (auto& extent : usable) {
+            add_range(Frame::containing_address(extent.start), extent.frames());
+        }
+    }
 
-    void FreeList::init(Frame *backing_buffer, size_t capacity) {
-        data_ = backing_buffer;
-        capacity_ = capacity;
-        size_ = 0;
-        heap_owner_ = nullptr;
-        uses_heap_storage_ = false;
+    void AreaFrameAllocator::add_range(Frame start, uint64_t count) {
+        // every zone only takes the part of the run that it covers
+        dma_zone.add_range(start, count);
+        dma32_zone.add_range(start, count);
+        normal_zone.add_range(start, count);
     }
 
-    bool FreeList::try_grow(BlockAllocator *heap) {
-        if (heap == nullptr) {
-            return false;
-        }
+    AreaFrameAllocator* AreaFrameAllocator::from_boot_info(const BootInfo &boot_info, void* storage) {
+        UsableMemory usable;
+        UsableMemory::from_boot_info(boot_info, usable);
 
-        size_t new_capacity = capacity_ * 2;
-        size_t bytes = new_capacity * sizeof(Frame);
-        void* mem = heap->allocate(bytes, alignof(Frame));
-        if (!mem) {
-            return false;
+        auto& out = vga::out();
+        out << "Usable memory: " << dec << usable.size() << " extents" << out.endl;
+        for (auto& extent : usable) {
+            out << "  " << hex << extent.start << " - " << extent.end << out.endl;
         }
 
-        Frame* new_data = reinterpret_cast<Frame*>(mem);
-        for (size_t i = 0; i < size_; i++) {
-            new_data[i] = data_[i];
-        }
+        auto allocator = new (storage) AreaFrameAllocator(usable);
 
-        if (uses_heap_storage_ && heap_owner_) {
-            heap_owner_->deallocate(data_, capacity_ * sizeof(Frame));
-        }
-
-        data_ = new_data;
-        capacity_ = new_capacity;
-        heap_owner_ = heap;
-        uses_heap_storage_ = true;
-        return true;
+        out << "Free frames: " << dec << allocator->free_frames()
+            << " (DMA " << allocator->free_frames(Zone::DMA)
+            << ", DMA32 " << allocator->free_frames(Zone::DMA32)
+            << ", Normal " << allocator->free_frames(Zone::NORMAL) << ")" << out.endl;
+        return allocator;
     }
 
-    bool FreeList::push(Frame frame, BlockAllocator *heap) {
-        if (size_ >= capacity_) {
-            if (!try_grow(heap)) {
-                return false;
+    rnt::Optional<Frame> AreaFrameAllocator::allocate_frame() {
+        cpu::InterruptGuard guard;
+        auto& magazine = magazines[cpu::current_id()];
+        if (magazine.count == 0) {
+            refill(magazine);
+            if (magazine.count == 0) {
+                // Out of memory
+                return rnt::Optional<Frame>();
             }
         }
-        data_[size_++] = frame;
-        return true;
+        return Frame(magazine.frames[--magazine.count]);
     }
 
-    rnt::Optional<Frame> FreeList::pop() {
-        if (size_ == 0) {
-            return rnt::Optional<Frame>();
+    void AreaFrameAllocator::deallocate_frame(memory::Frame frame) {
+        // like add_range, ignore frames above MAX_PHYSICAL_MEMORY, no zone could take them back
+        if (frame.number >= MAX_FRAMES) {
+            return;
         }
-        size_--;
-        return data_[size_];
-    }
-
-    AreaFrameAllocator::AreaFrameAllocator(
-        const Multiboot2TagMmap* mmap,
-        PhysicalAddress kernel_start,
-        PhysicalAddress kernel_end,
-        PhysicalAddress multiboot_start,
-        PhysicalAddress multiboot_end
-    )
-        : mmap(mmap)
-        , current_area(nullptr)
-        , current_iterator()
-        , has_valid_iterator(false)
-        , kernel_start(kernel_start)
-        , kernel_end(kernel_end)
-        , multiboot_start(multiboot_start)
-        , multiboot_end(multiboot_end)
-    {
-        free_list.init(free_list_storage, INITIAL_FREE_CAPACITY);
-        // Find first available area and create iterator
-        for (auto area = mmap->entries_begin(); area != mmap->entries_end(); ++area) {
-            if (area->is_available()) {
-                current_area = area;
-                current_iterator = AreaFrameIterator(
-                    area,
-                    kernel_start,
-                    kernel_end,
-                    multiboot_start,
-                    multiboot_end
-                );
-                has_valid_iterator = true;
+        cpu::InterruptGuard guard;
+        auto& magazine = magazines[cpu::current_id()];
+        if (magazine.count == FRAME_MAGAZINE_SIZE) {
+            drain(magazine, FRAME_MAGAZINE_BATCH);
+        }
+        magazine.frames[magazine.count++] = frame.number;
+    }
+
+    void AreaFrameAllocator::refill(FrameMagazine &magazine) {
+        SpinLockGuard lock_guard(lock);
+        while (magazine.count < FRAME_MAGAZINE_BATCH) {
+            auto frame = allocate_from_zones(1, 1, UINT64_MAX / PAGE_SIZE);
+            if (frame.is_empty()) {
+                // zeroed frames are still free frames
+                frame = pop_zeroed();
+            }
+            if (frame.is_empty()) {
                 break;
             }
+            magazine.frames[magazine.count++] = frame.value().number;
+        }
+    }
+
+    void AreaFrameAllocator::drain(FrameMagazine &magazine, uint32_t count) {
+        SpinLockGuard lock_guard(lock);
+        while (count > 0 && magazine.count > 0) {
+            deallocate_to_zone(Frame(magazine.frames[--magazine.count]));
+            count--;
         }
     }
 
-    AreaFrameAllocator AreaFrameAllocator::from_boot_info(const BootInfo &boot_info) {
-        uint64_t kernel_start = UINT64_MAX;
-        uint64_t kernel_end = 0;
-        auto elf_sections = boot_info.get_elf_sections();
-        if (elf_sections.has_value()) {
-            const auto elf = elf_sections.value();
+    rnt::Optional<Frame> AreaFrameAllocator::pop_zeroed() {
+        if (zeroed_count == 0) {
+            return rnt::Optional<Frame>();
+        }
+        auto frame = Frame(zeroed_head);
+        auto link = paging::phys_to_virt<uint64_t>(frame.start_address());
+        zeroed_head = *link;
+        zeroed_count--;
+        *link = 0;
+        return frame;
+    }
 
-            for (auto section = elf->sections_begin(); section != elf->sections_end(); ++section) {
-                if (section->size == 0) continue;
-                if (section->addr < kernel_start) kernel_start = section->addr;
-                if (section->addr + section->size > kernel_end) kernel_end = section->addr + section->size;
+    rnt::Optional<Frame> AreaFrameAllocator::allocate_zeroed_frame() {
+        {
+            cpu::InterruptGuard guard;
+            SpinLockGuard lock_guard(lock);
+            auto frame = pop_zeroed();
+            if (frame.has_value()) {
+                return frame;
             }
         }
 
-        auto& out = vga::out();
-        out << "Kernel Start: " << hex << kernel_start << out.endl;
-        out << "Kernel End: " << hex << kernel_end << out.endl;
-        out << "Kernel Size: " << size << kernel_end << out.endl;
-
-        uint64_t multiboot_start = reinterpret_cast<uint64_t>(&boot_info);
-        uint64_t multiboot_end   = multiboot_start + boot_info.get_total_size();
-        return AreaFrameAllocator(boot_info.get_memory_map(), kernel_start, kernel_end, multiboot_start, multiboot_end);
+        // the pool ran dry, clear a frame on the spot
+        auto frame = allocate_frame();
+        if (frame.has_value()) {
+            memset(paging::phys_to_virt<void>(frame.value().start_address()), 0, PAGE_SIZE);
+        }
+        return frame;
     }
 
+    uint64_t AreaFrameAllocator::refill_zeroed(uint64_t max_frames) {
+        uint64_t added = 0;
+        while (added < max_frames && zeroed_count < ZEROED_POOL_TARGET) {
+            auto frame = allocate_frame();
+            if (frame.is_empty()) {
+                break;
+            }
+
+            // Non-temporal stores: the frame is not read until it is handed out, so it
+            // should not push the working set out of the cache.
+            auto page = paging::phys_to_virt<uint32_t>(frame.value().start_address());
+            rnt::memset32_nt(page, 0, PAGE_SIZE / sizeof(uint32_t));
 
-    void AreaFrameAllocator::advance_to_next_area() {
-        if (current_area == nullptr) {
-            return;
+            cpu::InterruptGuard guard;
+            SpinLockGuard lock_guard(lock);
+            *reinterpret_cast<uint64_t*>(page) = zeroed_head;
+            zeroed_head = frame.value().number;
+            zeroed_count++;
+            added++;
         }
+        return added;
+    }
 
-        has_valid_iterator = false;
+    void AreaFrameAllocator::deallocate_to_zone(Frame frame) {
+        if (dma_zone.contains(frame)) {
+            dma_zone.deallocate(frame, 0);
+        } else if (dma32_zone.contains(frame)) {
+            dma32_zone.deallocate(frame, 0);
+        } else {
+            normal_zone.deallocate(frame, 0);
+        }
+    }
 
-        // Move to next area
-        current_area++;
+    rnt::Optional<Frame> AreaFrameAllocator::allocate_in_zone(Zone zone, uint64_t count, uint64_t align_frames, uint64_t limit_frame) {
+        // the smallest order that covers both the count and the alignment
+        uint8_t order = 0;
+        while ((1ULL << order) < count || (1ULL << order) < align_frames) {
+            order++;
+        }
 
-        // Find next available area
-        while (current_area < mmap->entries_end()) {
-            if (current_area->is_available()) {
-                current_iterator = AreaFrameIterator(
-                    current_area,
-                    kernel_start,
-                    kernel_end,
-                    multiboot_start,
-                    multiboot_end
-                );
-                has_valid_iterator = true;
-                return;
-            }
-            current_area++;
+        if (order > BUDDY_MAX_ORDER) {
+            return zone == Zone::DMA ? dma_zone.allocate_run(count, align_frames, limit_frame)
+                 : zone == Zone::DMA32 ? dma32_zone.allocate_run(count, align_frames, limit_frame)
+                 : normal_zone.allocate_run(count, align_frames, limit_frame);
         }
 
-        // No more areas
-        current_area = nullptr;
+        auto block = zone == Zone::DMA ? dma_zone.allocate(order, limit_frame)
+                   : zone == Zone::DMA32 ? dma32_zone.allocate(order, limit_frame)
+                   : normal_zone.allocate(order, limit_frame);
+        if (block.has_value() && count < (1ULL << order)) {
+            // hand back the frames behind the requested count
+            add_range(Frame(block.value().number + count), (1ULL << order) - count);
+        }
+        return block;
     }
 
-    rnt::Optional<Frame> AreaFrameAllocator::allocate_frame() {
-        // Reuse a freed frame if available.
-        auto reused = free_list.pop();
-        if (reused.has_value()) {
-            return reused;
-        }
+    rnt::Optional<Frame> AreaFrameAllocator::allocate_frames(uint64_t count, uint64_t align, PhysicalAddress max_phys) {
+        ASSERT(count > 0, "Cannot allocate zero frames");
+        ASSERT((align & (align - 1)) == 0 && align >= PAGE_SIZE, "Frame alignment must be a power of 2 of at least PAGE_SIZE");
+
+        uint64_t align_frames = align / PAGE_SIZE;
+        uint64_t limit_frame = max_phys / PAGE_SIZE;
 
-        // Keep trying until we find a frame or run out of areas
-        while (has_valid_iterator) {
-            if (current_iterator.has_next()) {
-                return current_iterator.next();
+        cpu::InterruptGuard guard;
+        {
+            SpinLockGuard lock_guard(lock);
+            auto frames = allocate_from_zones(count, align_frames, limit_frame);
+            if (frames.has_value()) {
+                return frames;
             }
+        }
+
+        // The frames we need might sit in the magazine of this CPU or in the zeroed pool,
+        // both count as free. Give them back so the buddies can merge. Other magazines
+        // belong to their CPUs.
+        auto& magazine = magazines[cpu::current_id()];
+        drain(magazine, magazine.count);
+        SpinLockGuard lock_guard(lock);
+        for (auto frame = pop_zeroed(); frame.has_value(); frame = pop_zeroed()) {
+            deallocate_to_zone(frame.value());
+        }
+        return allocate_from_zones(count, align_frames, limit_frame);
+    }
 
-            // Current area exhausted, move to next
-            advance_to_next_area();
+    rnt::Optional<Frame> AreaFrameAllocator::allocate_from_zones(uint64_t count, uint64_t align_frames, uint64_t limit_frame) {
+        // prefer the highest zone so that low memory stays available for devices that need it
+        constexpr Zone fallback_order[] = {Zone::NORMAL, Zone::DMA32, Zone::DMA};
+        for (auto zone : fallback_order) {
+            auto frames = allocate_in_zone(zone, count, align_frames, limit_frame);
+            if (frames.has_value()) {
+                return frames;
+            }
         }
 
         // Out of memory
         return rnt::Optional<Frame>();
     }
 
-    void AreaFrameAllocator::deallocate_frame(memory::Frame frame) {
-        // Store the frame for later reuse. Grow using the heap if available.
-        ASSERT(free_list.push(frame, kernel_heap), "Frame free list exhausted");
+    void AreaFrameAllocator::deallocate_frames(Frame start, uint64_t count) {
+        if (count == 1) {
+            deallocate_frame(start);
+            return;
+        }
+        cpu::InterruptGuard guard;
+        SpinLockGuard lock_guard(lock);
+        add_range(start, count);
     }
 
-    void AreaFrameAllocator::update_pointers_to_high(uint64_t offset) {
-        // Update mmap pointer to high address (no VGA output to avoid touching low memory)
-        if (mmap != nullptr) {
-            mmap = reinterpret_cast<const Multiboot2TagMmap*>(
-                reinterpret_cast<uint64_t>(mmap) + offset
-            );
+    uint64_t AreaFrameAllocator::free_frames() const {
+        uint64_t cached = 0;
+        for (auto& magazine : magazines) {
+            cached += magazine.count;
         }
+        return dma_zone.free_frames() + dma32_zone.free_frames() + normal_zone.free_frames() + cached + zeroed_count;
+    }
 
-        // Update current_area pointer if it's valid
-        if (current_area != nullptr) {
-            current_area = reinterpret_cast<const MemoryArea*>(
-                reinterpret_cast<uint64_t>(current_area) + offset
-            );
+    uint64_t AreaFrameAllocator::free_frames(Zone zone) const {
+        switch (zone) {
+            case Zone::DMA: return dma_zone.free_frames();
+            case Zone::DMA32: return dma32_zone.free_frames();
+            case Zone::NORMAL: return normal_zone.free_frames();
         }
-
-        // Note: AreaFrameIterator stores frame numbers, not pointers, so no update needed
-        // Note: FreeList data pointer will be updated separately if needed
+        return 0;
     }
 }
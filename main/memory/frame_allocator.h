@@ -5,101 +5,168 @@
 #ifndef MAIN_FRAME_H
 #define MAIN_FRAME_H
 
-#include "AreaFrameIterator.h"
+#include "BuddyAllocator.h"
+#include "UsableMemory.h"
 #include "bootinfo.hpp"
 #include "runtime/optional.h"
+#include "runtime/spinlock.h"
+#include "x86/cpu.h"
 #include <stddef.h>
 
-// Forward declarations
-struct Multiboot2TagMmap;
-struct MemoryArea;
-
 namespace memory {
 
-    class BlockAllocator;
-
     /**
-     * Simple LIFO free list for frames.
-     * Backed by a small static buffer and can grow using the kernel heap once available.
+     * Physical memory zones, split at the classic device addressing limits
      */
-    class FreeList {
-    public:
-        void init(Frame* backing_buffer, size_t capacity);
-        bool push(Frame frame, BlockAllocator* heap);
-        rnt::Optional<Frame> pop();
-        bool empty() const { return size_ == 0; }
-
-    private:
-        Frame*   data_ = nullptr;
-        size_t   capacity_ = 0;
-        size_t   size_ = 0;
-        BlockAllocator* heap_owner_ = nullptr;
-        bool     uses_heap_storage_ = false;
-
-        bool try_grow(BlockAllocator* heap);
+    enum class Zone : uint8_t {
+        DMA = 0,     // below 16 MiB (ISA DMA)
+        DMA32 = 1,   // below 4 GiB (32-bit devices)
+        NORMAL = 2,  // everything else
     };
 
     /**
      * Frame allocator that uses memory areas from multiboot memory map
-     * Allocates frames from available physical memory regions
+     * The available areas are split into zones once at boot, each zone is backed by
+     * its own buddy allocator, which then serves all allocations and frees without
+     * touching the kernel heap.
+     *
+     * Single frames go through a small per-CPU magazine, so the common allocate and free
+     * is an array pop or push with interrupts off. Magazines are refilled from and drained
+     * to the zones in batches, and only the zones are shared between CPUs, behind a lock.
+     *
+     * A pool of frames that are already zeroed serves allocate_zeroed_frame(), so page
+     * tables and demand paged memory do not have to be cleared on the hot path. The pool
+     * is filled by refill_zeroed() whenever the kernel has nothing else to do.
      */
     class AreaFrameAllocator {
+    public:
+        // Physical memory above this limit is ignored (bounds the buddy bitmaps to ~1 MiB)
+        static constexpr uint64_t MAX_PHYSICAL_MEMORY = 16ULL * 1024 * 1024 * 1024;
+        static constexpr uint64_t MAX_FRAMES = MAX_PHYSICAL_MEMORY / PAGE_SIZE;
+
+        static constexpr PhysicalAddress DMA_LIMIT = 16ULL * 1024 * 1024;
+        static constexpr PhysicalAddress DMA32_LIMIT = 4ULL * 1024 * 1024 * 1024;
+        static constexpr uint64_t DMA_FRAMES = DMA_LIMIT / PAGE_SIZE;
+        static constexpr uint64_t DMA32_FRAMES = (DMA32_LIMIT - DMA_LIMIT) / PAGE_SIZE;
+        static constexpr uint64_t NORMAL_FRAMES = MAX_FRAMES - DMA_FRAMES - DMA32_FRAMES;
+
+        // Frames a per-CPU magazine holds at most
+        static constexpr uint32_t FRAME_MAGAZINE_SIZE = 64;
+        // Frames moved between a magazine and the zones at once
+        static constexpr uint32_t FRAME_MAGAZINE_BATCH = 32;
+        // Zeroed frames refill_zeroed() keeps ready
+        static constexpr uint64_t ZEROED_POOL_TARGET = 256;
+
     private:
-        const Multiboot2TagMmap* mmap;
-        const MemoryArea* current_area;
-        AreaFrameIterator current_iterator;
-        bool has_valid_iterator;
-        PhysicalAddress kernel_start;
-        PhysicalAddress kernel_end;
-        PhysicalAddress multiboot_start;
-        PhysicalAddress multiboot_end;
-        static constexpr size_t INITIAL_FREE_CAPACITY = 128;
-        FreeList free_list;
-        Frame free_list_storage[INITIAL_FREE_CAPACITY];
+        struct FrameMagazine {
+            uint32_t count;
+            uint64_t frames[FRAME_MAGAZINE_SIZE];
+        };
+
+        FrameMagazine magazines[cpu::MAX_CPUS];
+        // protects the zones and the zeroed pool
+        SpinLock lock;
+
+        // Zeroed frames, linked through their first word which is cleared when handed out
+        uint64_t zeroed_head;
+        uint64_t zeroed_count;
+
+        BuddyAllocator<DMA_FRAMES> dma_zone;
+        BuddyAllocator<DMA32_FRAMES> dma32_zone;
+        BuddyAllocator<NORMAL_FRAMES> normal_zone;
+
+        /**
+         * Hand a run of free frames to the zones it overlaps
+         */
+        void add_range(Frame start, uint64_t count);
+
+        rnt::Optional<Frame> allocate_in_zone(Zone zone, uint64_t count, uint64_t align_frames, uint64_t limit_frame);
+        // The zone helpers expect the lock to be held
+        rnt::Optional<Frame> allocate_from_zones(uint64_t count, uint64_t align_frames, uint64_t limit_frame);
+        void deallocate_to_zone(Frame frame);
+        rnt::Optional<Frame> pop_zeroed();
+
+        /**
+         * Move up to FRAME_MAGAZINE_BATCH frames from the zones into the magazine.
+         * Called with interrupts disabled.
+         */
+        void refill(FrameMagazine& magazine);
 
         /**
-         * Find next available area and update current iterator
+         * Hand up to `count` frames of the magazine back to the zones.
+         * Called with interrupts disabled.
          */
-        void advance_to_next_area();
+        void drain(FrameMagazine& magazine, uint32_t count);
 
     public:
         /**
-         * Initialize frame allocator with memory map and kernel bounds
-         * @param mmap Memory map from multiboot
-         * @param kernel_start Physical start address of kernel
-         * @param kernel_end Physical end address of kernel
-         * @param multiboot_start Physical start address of multiboot info
-         * @param multiboot_end Physical end address of multiboot info
+         * Initialize frame allocator with the usable memory left after boot
+         * @param usable Extents of free memory, handed to the zones as a whole
          */
-        AreaFrameAllocator(
-            const Multiboot2TagMmap* mmap,
-            PhysicalAddress kernel_start,
-            PhysicalAddress kernel_end,
-            PhysicalAddress multiboot_start,
-            PhysicalAddress multiboot_end
-        );
+        explicit AreaFrameAllocator(const UsableMemory& usable);
 
-        static AreaFrameAllocator from_boot_info(
-            const BootInfo& boot_info
+        /**
+         * Construct the allocator in the given storage.
+         * The allocator is too large to be built on the boot stack and moved, so it is
+         * always constructed in place.
+         * @param storage Memory of at least sizeof(AreaFrameAllocator) bytes
+         */
+        static AreaFrameAllocator* from_boot_info(
+            const BootInfo& boot_info,
+            void* storage
         );
 
         /**
-         * Allocate a single frame
+         * Allocate a single frame from the magazine of this CPU, which is refilled
+         * preferring the highest zone
          */
         rnt::Optional<Frame> allocate_frame();
 
         /**
-         * Deallocate a frame (currently a no-op, future: bitmap allocator)
+         * Allocate a frame that is filled with zeros, from the zeroed pool if possible
+         */
+        rnt::Optional<Frame> allocate_zeroed_frame();
+
+        /**
+         * Zero up to `max_frames` free frames with non-temporal stores and add them to the
+         * zeroed pool, until it holds ZEROED_POOL_TARGET frames.
+         * Meant for idle time, interrupts stay enabled while a frame is cleared.
+         * @return The number of frames added, 0 once the pool is full or memory runs out
+         */
+        uint64_t refill_zeroed(uint64_t max_frames);
+
+        /**
+         * Deallocate a frame into the magazine of this CPU. Frames drained from a full
+         * magazine are merged with their free buddies. Frames above MAX_PHYSICAL_MEMORY
+         * are ignored.
          * @param frame Frame to deallocate
          */
         void deallocate_frame(Frame frame);
 
         /**
-         * Update internal pointers to use high addresses after jumping to higher-half
-         * This is necessary because the allocator is created at low addresses before the jump
-         * @param offset Offset to add to all pointers (typically KERNEL_OFFSET)
+         * Allocate physically contiguous frames
+         * @param count Number of frames
+         * @param align Alignment of the first frame in bytes (power of 2, at least PAGE_SIZE)
+         * @param max_phys The whole run must lie below this physical address
+         */
+        rnt::Optional<Frame> allocate_frames(uint64_t count, uint64_t align = PAGE_SIZE, PhysicalAddress max_phys = UINT64_MAX);
+
+        /**
+         * Deallocate a run of frames obtained from allocate_frames()
+         * @param start First frame of the run
+         * @param count Number of frames, as passed to allocate_frames()
+         */
+        void deallocate_frames(Frame start, uint64_t count);
+
+        /**
+         * Free frames, including those cached in magazines and the zeroed pool
+         */
+        uint64_t free_frames() const;
+
+        /**
+         * Free frames in a zone, without the frames cached in magazines and the zeroed pool
          */
-        void update_pointers_to_high(uint64_t offset);
+        uint64_t free_frames(Zone zone) const;
     };
 }
 #endif //MAIN_FRAME_H
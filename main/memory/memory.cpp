@@ -3,7 +3,8 @@
 #include "bootinfo.hpp"
 #include "frame_allocator.h"
 #include "paging/paging.h"
-#include "virtual/BlockAllocator.h"
+#include "paging/tlb.h"
+#include "virtual/KernelHeap.h"
 #include "x86/regs.h"
 
 // Forward declaration from main.cpp
@@ -11,12 +12,46 @@ extern "C" void kernel_main_high() __attribute__((noreturn));
 
 namespace memory {
 
-    static BlockAllocator(kernel_heap_obj);
-    BlockAllocator* kernel_heap = &kernel_heap_obj;
+    static KernelHeap kernel_heap_obj;
+    KernelHeap* kernel_heap = &kernel_heap_obj;
 
     alignas(AreaFrameAllocator) static uint8_t frame_allocator_storage[sizeof(AreaFrameAllocator)];
     AreaFrameAllocator *frame_allocator = nullptr;
 
+    // Boot-only memory, collected while the boot information is valid and handed to the
+    // frame allocator by reclaim_boot_memory()
+    static UsableMemory boot_kernel_half;
+    static UsableMemory boot_physmap;
+
+    // Frames kept back when growing the heap, for the page tables of the new mapping
+    // and for whatever else runs out of memory first
+    constexpr uint64_t HEAP_GROW_RESERVE_FRAMES = 64;
+
+    /**
+     * Map fresh frames behind the kernel heap, 0 once the heap window or physical memory is exhausted
+     */
+    size_t grow_kernel_heap(VirtualAddress heap_end, size_t min_size) {
+        auto size = align_up(min_size, PAGE_SIZE);
+        if (heap_end + size > HEAP_START + HEAP_MAX_SIZE) {
+            return 0;
+        }
+        if (frame_allocator->free_frames() < size / PAGE_SIZE + HEAP_GROW_RESERVE_FRAMES) {
+            return 0;
+        }
+
+        auto& page_table = paging::ActivePageTable::instance();
+        if (!page_table.map_range(paging::Page::containing_address(heap_end), size / PAGE_SIZE,
+                                  paging::PageFlags{.writable = true, .global = true}, *frame_allocator)) {
+            return 0;
+        }
+        return size;
+    }
+
+    void shrink_kernel_heap(VirtualAddress start, size_t size) {
+        auto& page_table = paging::ActivePageTable::instance();
+        page_table.unmap_range(paging::Page::containing_address(start), size / PAGE_SIZE, *frame_allocator);
+    }
+
     void init_and_jump_high(BootInfo& boot_info) {
         auto& out = vga::out();
 
@@ -24,9 +59,23 @@ namespace memory {
         efer::enable_nxe_bit();
         // Enable WRITE protect bit for pages
         cr0::enable_write_protect();
+        // Make PAT entry 4 write-combining for framebuffer mappings, if there is a PAT
+        pat::init();
+
+        frame_allocator = AreaFrameAllocator::from_boot_info(boot_info, frame_allocator_storage);
+        UsableMemory::boot_only(boot_info, BootRange::KERNEL_HALF, boot_kernel_half);
+        UsableMemory::boot_only(boot_info, BootRange::PHYSMAP, boot_physmap);
+        // The zones do not cover memory above this, so there is nothing to give back.
+        // The end is page aligned, reserve() would wrap it to 0 while rounding it up.
+        constexpr PhysicalAddress above_zones_end = UINT64_MAX & ~(PAGE_SIZE - 1);
+        boot_kernel_half.reserve(AreaFrameAllocator::MAX_PHYSICAL_MEMORY, above_zones_end);
+        boot_physmap.reserve(AreaFrameAllocator::MAX_PHYSICAL_MEMORY, above_zones_end);
+
+        // Enable global pages and PCIDs before the first kernel mappings are created
+        tlb::init();
 
-        auto temp_var = AreaFrameAllocator::from_boot_info(boot_info);
-        frame_allocator = new (frame_allocator_storage) AreaFrameAllocator(rnt::move(temp_var));
+        // Map all RAM into the kernel half, all page table edits go through it from now on
+        paging::init_physmap(*frame_allocator, boot_info);
 
         // Remap kernel with double mapping (low + high)
         paging::remap_the_kernel(*frame_allocator, boot_info);
@@ -35,14 +84,12 @@ namespace memory {
         // Map heap at high addresses (before jumping so frame_allocator still works)
         auto page_table = paging::ActivePageTable::instance();
         auto heap_start_page = paging::Page::containing_address(HEAP_START);
-        auto heap_end_page = paging::Page::containing_address(HEAP_START + HEAP_SIZE);
-        for (auto i = heap_start_page.number; i <= heap_end_page.number; i++) {
-            page_table.map(paging::Page(i), paging::PageFlags{.writable = true}, *frame_allocator);
-        }
+        auto heap_mapped = page_table.map_range(heap_start_page, HEAP_SIZE / PAGE_SIZE, paging::PageFlags{.writable = true, .global = true}, *frame_allocator);
+        ASSERT(heap_mapped, "Out of memory mapping the heap");
 
-        // Update frame allocator pointers to high addresses before unmapping
+        // Update frame allocator pointer to high addresses before unmapping
+        // (the allocator itself holds no pointers, its bitmaps live inside the object)
         out << "Updating frame allocator to use high addresses..." << out.endl;
-        frame_allocator->update_pointers_to_high(paging::KERNEL_OFFSET);
         frame_allocator = (AreaFrameAllocator*) ((uint64_t)frame_allocator + paging::KERNEL_OFFSET);
 
         out << "Frame allocator updated!" << out.endl;
@@ -59,10 +106,34 @@ namespace memory {
         out << "Initializing heap..." << out.endl;
 
         // No need for placement new anymore - no vtables!
-        kernel_heap_obj.init(HEAP_START, HEAP_SIZE);
+        kernel_heap_obj.init(HEAP_START, HEAP_SIZE, HeapGrowth{grow_kernel_heap, shrink_kernel_heap}, HEAP_MAX_SIZE);
         kernel_heap = &kernel_heap_obj;
 
         out << "Heap initialized at " << hex << (uint64_t)kernel_heap << out.endl;
     }
-}
 
+    void reclaim_boot_memory() {
+        auto& out = vga::out();
+        auto page_table = paging::ActivePageTable::instance();
+
+        // the kernel half alias has to go first, unmapping hands the frame back
+        for (auto& extent : boot_kernel_half) {
+            for (auto address = extent.start; address < extent.end; address += PAGE_SIZE) {
+                auto page = paging::Page::containing_address(address + paging::KERNEL_OFFSET);
+                if (page_table.translate(page.start_addr()).has_value()) {
+                    page_table.unmap(page, *frame_allocator);
+                } else {
+                    frame_allocator->deallocate_frame(Frame::containing_address(address));
+                }
+            }
+        }
+        for (auto& extent : boot_physmap) {
+            frame_allocator->deallocate_frames(Frame::containing_address(extent.start), extent.frames());
+        }
+
+        out << "Reclaimed boot memory: " << dec << boot_kernel_half.frames() << " kernel frames, "
+            << boot_physmap.frames() << " boot loader and ACPI frames" << out.endl;
+        boot_kernel_half = UsableMemory();
+        boot_physmap = UsableMemory();
+    }
+}
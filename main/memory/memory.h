@@ -10,16 +10,24 @@
 
 namespace memory {
     // Forward declarations
-    class BlockAllocator;
+    class KernelHeap;
     class AreaFrameAllocator;
 
-    extern BlockAllocator* kernel_heap;
+    extern KernelHeap* kernel_heap;
     extern AreaFrameAllocator* frame_allocator;
 
     // Initialize memory, remap kernel to high addresses, and jump to high half
     // This function does NOT return! It jumps to kernel_main_high()
     void init_and_jump_high(BootInfo& boot_info) __attribute__((noreturn));
     void init_heap();
+
+    /**
+     * Give the memory that was only needed during boot to the frame allocator: ACPI
+     * reclaimable areas, the boot information, the .boot section with the 32-bit bring-up
+     * code and the boot page tables. Everything needed from the boot information must have
+     * been copied out before.
+     */
+    void reclaim_boot_memory();
 }
 
 #endif //MAIN_MEMORY_H
@@ -0,0 +1,82 @@
+#include "Arena.h"
+#include "memory/frame_allocator.h"
+#include "memory/memory.h"
+#include "paging/physmap.h"
+#include "runtime/new.h"
+
+namespace memory {
+
+    constexpr size_t CHUNK_HEADER_SIZE = sizeof(ArenaChunk);
+
+    Arena::Arena(): current(nullptr), bump(0, 0) {}
+
+    bool Arena::add_chunk(size_t size, size_t align) {
+        // room for the header, the allocation and its worst case alignment padding
+        auto needed = saturating_add(saturating_add(CHUNK_HEADER_SIZE, size), align);
+        auto frames = align_up(needed, PAGE_SIZE) / PAGE_SIZE;
+
+        auto frame = frame_allocator->allocate_frames(frames);
+        if (frame.is_empty()) {
+            return false;
+        }
+
+        auto start = paging::phys_to_virt(frame.value().start_address());
+        auto chunk = reinterpret_cast<ArenaChunk*>(start);
+        chunk->prev = current;
+        chunk->frames = frames;
+        current = chunk;
+        new (&bump) BumpAllocator(start + CHUNK_HEADER_SIZE, start + frames * PAGE_SIZE);
+        return true;
+    }
+
+    void Arena::free_chunk(ArenaChunk *chunk) {
+        auto frame = Frame::containing_address(paging::virt_to_phys(chunk));
+        frame_allocator->deallocate_frames(frame, chunk->frames);
+    }
+
+    void *Arena::allocate(size_t size, size_t align) {
+        if (align == 0) {
+            align = 1;
+        }
+        ASSERT(is_power_of_2(align), "Alignment must be power of 2");
+
+        if (current) {
+            auto ptr = bump.allocate(size, align);
+            if (ptr) {
+                return ptr;
+            }
+        }
+
+        // The rest of a full chunk is wasted, that keeps allocation a pointer bump
+        if (!add_chunk(size, align)) {
+            return nullptr;
+        }
+        return bump.allocate(size, align);
+    }
+
+    Arena::Mark Arena::mark() const {
+        return Mark{current, current ? bump.position() : 0};
+    }
+
+    void Arena::reset(Mark mark) {
+        while (current != mark.chunk) {
+            ASSERT(current != nullptr, "Mark does not belong to this arena");
+            auto chunk = current;
+            current = chunk->prev;
+            free_chunk(chunk);
+        }
+        if (current == nullptr) {
+            new (&bump) BumpAllocator(0, 0);
+            return;
+        }
+
+        auto start = reinterpret_cast<VirtualAddress>(current);
+        new (&bump) BumpAllocator(start + CHUNK_HEADER_SIZE, start + current->frames * PAGE_SIZE);
+        bump.rewind(mark.position);
+    }
+
+    void Arena::release() {
+        reset(Mark{nullptr, 0});
+    }
+
+}
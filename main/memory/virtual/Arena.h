@@ -0,0 +1,78 @@
+#ifndef MAIN_ARENA_H
+#define MAIN_ARENA_H
+
+#include "BumpAllocator.h"
+#include "VirtualAllocator.h"
+
+namespace memory {
+
+    // Header at the start of every chunk, the rest of the chunk is bump allocated
+    struct ArenaChunk {
+        ArenaChunk* prev;
+        uint64_t frames;
+    };
+
+    /**
+     * Region allocator for memory with a common lifetime.
+     *
+     * Allocations bump a pointer through the current chunk with BumpAllocator. When the
+     * chunk is full, a new chunk of physically contiguous frames is taken from the frame
+     * allocator and reached through the physmap, so arenas work without the kernel heap.
+     * Chunks are a single frame unless an allocation needs more.
+     *
+     * Nothing is freed on its own: reset() drops everything allocated after a mark and
+     * release() gives every chunk back, both in O(number of chunks). An arena belongs to
+     * one owner, the chunk switch is not synchronized.
+     */
+    class Arena {
+        ArenaChunk* current;
+        BumpAllocator bump;
+
+        bool add_chunk(size_t size, size_t align);
+        void free_chunk(ArenaChunk *chunk);
+
+    public:
+        // Position in an arena, everything allocated after it can be dropped with reset()
+        struct Mark {
+            ArenaChunk* chunk;
+            VirtualAddress position;
+        };
+
+        Arena();
+
+        /**
+         * Allocate `size` bytes aligned to `align` (power of 2), nullptr if no frames are left
+         */
+        void *allocate(size_t size, size_t align);
+
+        Mark mark() const;
+
+        /**
+         * Free everything allocated after the mark was taken, chunks added since are released
+         */
+        void reset(Mark mark);
+
+        /**
+         * Free everything and give all chunks back to the frame allocator
+         */
+        void release();
+    };
+
+    /**
+     * Resets an arena to where it was when the scope was entered
+     */
+    class ArenaScope {
+        Arena& arena;
+        Arena::Mark start;
+
+    public:
+        explicit ArenaScope(Arena& arena): arena(arena), start(arena.mark()) {}
+        ~ArenaScope() { arena.reset(start); }
+
+        ArenaScope(const ArenaScope&) = delete;
+        ArenaScope& operator=(const ArenaScope&) = delete;
+    };
+
+}
+
+#endif //MAIN_ARENA_H
@@ -3,71 +3,205 @@
 //
 
 #include "BlockAllocator.h"
+#include "runtime/string.h"
 
 namespace memory {
 
-    rnt::Optional<size_t> size_index(size_t size, size_t alignment);
+    // The heap grows by at least this much at once
+    constexpr size_t HEAP_GROW_MIN = 64 * 1024;
+    // Free space at the end of the heap above this is handed back ...
+    constexpr size_t HEAP_SHRINK_THRESHOLD = 4 * HEAP_GROW_MIN;
+    // ... except for this much, so a heap that oscillates does not map and unmap all the time
+    constexpr size_t HEAP_SHRINK_KEEP = HEAP_GROW_MIN;
 
-    void BlockAllocator::init(size_t heap_start, size_t heap_size) {
+    void BlockAllocator::init(size_t heap_start, size_t heap_size, HeapGrowth growth, size_t max_size) {
+        ASSERT(heap_start % PAGE_SIZE == 0 && heap_size % PAGE_SIZE == 0, "Heap must be page aligned");
+        if (max_size < heap_size) {
+            max_size = heap_size;
+        }
         fallback_allocator.init(heap_start, heap_size);
+        this->heap_start = heap_start;
+        this->heap_end = heap_start + heap_size;
+        this->growth = growth;
+
+        // the page map covers the whole window the heap can grow into
+        page_count = max_size / PAGE_SIZE;
+        page_classes = reinterpret_cast<uint8_t*>(fallback_alloc(page_count, alignof(uint64_t)));
+        ASSERT(page_classes != nullptr, "Heap too small for its page map");
+        memset(page_classes, PAGE_NO_CLASS, page_count);
     }
 
     void *BlockAllocator::fallback_alloc(size_t size, size_t alignment) {
+        auto ptr = fallback_allocator.allocate(size, alignment);
+        if (ptr || growth.grow == nullptr) {
+            return ptr;
+        }
+
+        // Out of space, map more memory behind the heap. The request may need room for
+        // alignment and a block header on top of its size.
+        auto min_size = size + alignment + PAGE_SIZE;
+        auto added = growth.grow(heap_end, min_size > HEAP_GROW_MIN ? min_size : HEAP_GROW_MIN);
+        if (added == 0) {
+            return nullptr;
+        }
+        fallback_allocator.extend_pool(heap_end, added);
+        heap_end += added;
         return fallback_allocator.allocate(size, alignment);
     }
 
+    void BlockAllocator::fallback_dealloc(void *ptr) {
+        fallback_allocator.deallocate(ptr);
+        if (growth.shrink == nullptr) {
+            return;
+        }
+
+        auto tail = fallback_allocator.free_tail(heap_end);
+        if (tail < HEAP_SHRINK_THRESHOLD) {
+            return;
+        }
+        auto release = align_down(tail - HEAP_SHRINK_KEEP, PAGE_SIZE);
+        fallback_allocator.shrink_pool(heap_end, release);
+        heap_end -= release;
+        growth.shrink(heap_end, release);
+    }
+
+    bool BlockAllocator::refill(uint8_t index) {
+        auto block_size = BLOCK_SIZES[index];
+        auto chunk_size = block_size * BLOCK_REFILL_MIN_BLOCKS;
+        if (chunk_size < BLOCK_REFILL_MIN) {
+            chunk_size = BLOCK_REFILL_MIN;
+        }
+
+        // Chunks are whole pages, so every page belongs to at most one class. Page
+        // alignment also keeps every block aligned to its size.
+        auto chunk = reinterpret_cast<uint8_t*>(fallback_alloc(chunk_size, PAGE_SIZE));
+        if (chunk == nullptr) {
+            return false;
+        }
+        auto first_page = (reinterpret_cast<VirtualAddress>(chunk) - heap_start) / PAGE_SIZE;
+        memset(page_classes + first_page, index, chunk_size / PAGE_SIZE);
+
+        // thread the blocks back to front, so they are handed out in address order
+        auto count = chunk_size / block_size;
+        for (size_t i = count; i > 0; i--) {
+            auto node = reinterpret_cast<BlockNode*>(chunk + (i - 1) * block_size);
+            *node = BlockNode(heads[index]);
+            heads[index] = node;
+        }
+        class_blocks[index] += count;
+        return true;
+    }
+
+    void *BlockAllocator::allocate_block(uint8_t index) {
+        if (heads[index] == nullptr && !refill(index)) {
+            return nullptr;
+        }
+
+        // remove the block from the free ones and return it
+        auto head = heads[index];
+        heads[index] = head->next;
+        class_in_use[index]++;
+        return head;
+    }
+
     void *BlockAllocator::allocate(size_t size, size_t align) {
+        return allocate_for(size, align, reinterpret_cast<uint64_t>(__builtin_return_address(0)));
+    }
+
+    void *BlockAllocator::allocate_for(size_t size, size_t align, uint64_t caller) {
         auto index = size_index(size, align);
-        if (index.is_empty()) {
-            return fallback_alloc(size, align);
-        }
-
-        auto i = index.value();
-        auto head = heads[i];
-        if (head) {
-            // we have a free block for the required size.
-            // remove the block from the free ones
-            heads[i] = head->next;
-            // return the selected block
-            return head;
-        }
-
-        // we don't have a free block for the minimal desired block size.
-        // we must allocate a new block with the desired size
-        auto block_size = BLOCK_SIZES[i];
-        // for simplicity, a block's alignment is its size
-        auto block_align = block_size;
-        // allocate the block with the fallback allocator.
-        // when the block is freed again, we will add it to the heads
-        return fallback_allocator.allocate(block_size, block_align);
+        auto ptr = index.is_empty() ? fallback_alloc(size, align) : allocate_block(index.value());
+#ifdef HEAP_PROFILE
+        if (ptr) {
+            auto size_class = index.is_empty() ? BLOCK_SIZE_COUNT : index.value();
+            profile.record_allocate(ptr, size, size_class, caller);
+        }
+#endif
+        return ptr;
     }
 
-    void BlockAllocator::deallocate(void *ptr, size_t size) {
-        auto index = size_index(size, size);
-        if (index.is_empty()) {
+    void BlockAllocator::deallocate(void *ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
+        auto address = reinterpret_cast<VirtualAddress>(ptr);
+        ASSERT(address >= heap_start && address < heap_end, "Pointer does not belong to this heap");
+#ifdef HEAP_PROFILE
+        profile.record_deallocate(ptr);
+#endif
+
+        auto i = page_classes[(address - heap_start) / PAGE_SIZE];
+        if (i == PAGE_NO_CLASS) {
             // was allocated via the fallback allocator
-            fallback_allocator.deallocate(ptr, size);
+            fallback_dealloc(ptr);
             return;
         }
+        ASSERT((address & (BLOCK_SIZES[i] - 1)) == 0, "Pointer is not the start of a block");
 
-        auto i = index.value();
         // create a new block node that points to the current head node
         // at the returned deallocation ptr.
         auto new_node = reinterpret_cast<BlockNode*>(ptr);
         *new_node = BlockNode(heads[i]);
         heads[i] = new_node;
+        class_in_use[i]--;
+    }
+
+    uint8_t BlockAllocator::size_class_of(const void *ptr) const {
+        // bounded by the page map instead of heap_end, which moves as the heap grows
+        auto address = reinterpret_cast<VirtualAddress>(ptr);
+        ASSERT(address >= heap_start && address < heap_start + page_count * PAGE_SIZE, "Pointer does not belong to this heap");
+        return page_classes[(address - heap_start) / PAGE_SIZE];
+    }
+
+    BlockClassStats BlockAllocator::class_stats(uint8_t index) const {
+        ASSERT(index < BLOCK_SIZE_COUNT, "Size class out of range");
+        return BlockClassStats{BLOCK_SIZES[index], class_blocks[index], class_in_use[index]};
     }
 
+    void BlockAllocator::print_stats(const StatsWriter& out) const {
+        for (uint8_t i = 0; i < BLOCK_SIZE_COUNT; i++) {
+            out.string("  ");
+            out.dec(BLOCK_SIZES[i]);
+            out.string(" B: ");
+            out.dec(class_in_use[i]);
+            out.string(" / ");
+            out.dec(class_blocks[i]);
+            out.string(" blocks in use\n");
+        }
+
+        uint64_t free_blocks[TLSF_FL_COUNT];
+        uint64_t free_bytes[TLSF_FL_COUNT];
+        fallback_allocator.free_histogram(free_blocks, free_bytes);
+        out.string("  Free fallback blocks:\n");
+        for (uint8_t fl = 0; fl < TLSF_FL_COUNT; fl++) {
+            if (free_blocks[fl] == 0) {
+                continue;
+            }
+            out.string("    from ");
+            out.dec(fl == 0 ? 0 : 1ULL << (fl + TLSF_FL_SHIFT - 1));
+            out.string(" B: ");
+            out.dec(free_blocks[fl]);
+            out.string(" blocks, ");
+            out.dec(free_bytes[fl]);
+            out.string(" B\n");
+        }
 
+#ifdef HEAP_PROFILE
+        profile.print(out, BLOCK_SIZES, BLOCK_SIZE_COUNT);
+#endif
+    }
 
     rnt::Optional<size_t> size_index(size_t size, size_t alignment) {
         auto required_block_size = size > alignment ? size : alignment;
-        for (int i = 0; i < BLOCK_SIZE_COUNT; i++) {
-            if (BLOCK_SIZES[i] >= required_block_size) {
-                return i;
-            }
+        if (required_block_size > BLOCK_SIZES[BLOCK_SIZE_COUNT - 1]) {
+            return {};
+        }
+        if (required_block_size <= BLOCK_SIZES[0]) {
+            return 0;
         }
-        return {};
+        // the smallest power of 2 that holds the block, as an index into BLOCK_SIZES
+        size_t log2 = 64 - __builtin_clzll(required_block_size - 1);
+        return log2 - BLOCK_SIZE_MIN_LOG2;
     }
 
 }
@@ -4,13 +4,27 @@
 
 #ifndef MAIN_BLOCKALLOCATOR_H
 #define MAIN_BLOCKALLOCATOR_H
-#include "LinkedListAllocator.h"
+#include "HeapProfile.h"
+#include "TlsfAllocator.h"
 #include "VirtualAllocator.h"
 
 namespace memory {
 
-    static constexpr size_t BLOCK_SIZES[] = {8, 16, 32, 64, 128, 256, 512, 1024, 2028};
+    // Size classes are consecutive powers of 2, so the class of a size is a bit scan away
+    static constexpr size_t BLOCK_SIZES[] = {8, 16, 32, 64, 128, 256, 512, 1024, 2048};
     static constexpr uint8_t BLOCK_SIZE_COUNT = sizeof(BLOCK_SIZES) / sizeof(size_t);
+    static constexpr uint8_t BLOCK_SIZE_MIN_LOG2 = 3;
+    static_assert(BLOCK_SIZE_COUNT < HEAP_PROFILE_MAX_CLASSES, "Heap profile cannot tell all size classes apart");
+
+    // An empty size class is refilled with a chunk of at least one page, carved into blocks
+    static constexpr size_t BLOCK_REFILL_MIN = PAGE_SIZE;
+    static constexpr size_t BLOCK_REFILL_MIN_BLOCKS = 8;
+
+    /**
+     * Index into BLOCK_SIZES of the class that serves an allocation, empty if it is too
+     * large for a size class
+     */
+    rnt::Optional<size_t> size_index(size_t size, size_t alignment);
 
     class BlockAllocator;
 
@@ -21,17 +35,92 @@ namespace memory {
         explicit BlockNode(BlockNode* next): next(next) {};
     };
 
+    /**
+     * Backing store for a heap that can change its size.
+     * Without hooks the heap keeps the size it was initialized with.
+     */
+    struct HeapGrowth {
+        // Map at least `min_size` bytes at `heap_end`, returns the mapped (page aligned) size or 0
+        size_t (*grow)(VirtualAddress heap_end, size_t min_size);
+        // Unmap the page aligned range `start` - `start + size` at the end of the heap
+        void (*shrink)(VirtualAddress start, size_t size);
+    };
+
+    struct BlockClassStats {
+        size_t block_size;
+        uint64_t blocks;   // blocks carved for this class so far
+        uint64_t in_use;
+    };
+
+    // Page map value of pages that do not belong to a size class
+    static constexpr uint8_t PAGE_NO_CLASS = 0xFF;
+
+    /**
+     * Size classes backed by a TLSF fallback allocator.
+     *
+     * Size classes are refilled with page aligned chunks, and a page map with one byte per
+     * heap page records the class of every page handed to a size class. Deallocation looks
+     * the class up from the pointer, anything else was allocated by the fallback allocator
+     * which keeps the size in its block header. No size is needed to free memory.
+     */
     class BlockAllocator {
         BlockNode* heads[BLOCK_SIZE_COUNT];
-        LinkedListAllocator fallback_allocator;
+        uint64_t class_blocks[BLOCK_SIZE_COUNT];
+        uint64_t class_in_use[BLOCK_SIZE_COUNT];
+        TlsfAllocator fallback_allocator;
+        VirtualAddress heap_start;
+        VirtualAddress heap_end;
+        // size class index of every page in the heap window, allocated from the heap itself
+        uint8_t* page_classes;
+        size_t page_count;
+        HeapGrowth growth;
+#ifdef HEAP_PROFILE
+        HeapProfile profile;
+#endif
     public:
-        BlockAllocator(): heads{nullptr}, fallback_allocator(LinkedListAllocator()) {}
-        void init(size_t heap_start, size_t heap_size);
+        BlockAllocator(): heads{nullptr}, class_blocks{0}, class_in_use{0}, fallback_allocator(),
+                          heap_start(0), heap_end(0), page_classes(nullptr), page_count(0), growth{nullptr, nullptr} {}
+
+        /**
+         * @param max_size Size the heap may grow to with the growth hooks, 0 for a heap of fixed size
+         */
+        void init(size_t heap_start, size_t heap_size, HeapGrowth growth = {nullptr, nullptr}, size_t max_size = 0);
         void *allocate(size_t size, size_t align);
-        void deallocate(void *ptr, size_t size);
+
+        /**
+         * allocate() on behalf of another allocator, which passes the address its own
+         * caller returns to for the heap profile
+         */
+        void *allocate_for(size_t size, size_t align, uint64_t caller);
+
+        /**
+         * Free memory returned by allocate, the size is looked up
+         */
+        void deallocate(void *ptr);
+
+        /**
+         * Size class index of an allocated block, PAGE_NO_CLASS if the fallback allocator
+         * holds it. The class of an allocated block never changes, so this is safe to
+         * call concurrently with allocations.
+         */
+        uint8_t size_class_of(const void *ptr) const;
+
+        /**
+         * Occupancy of the size class with the given index
+         */
+        BlockClassStats class_stats(uint8_t index) const;
+
+        /**
+         * Print the occupancy of every size class, the free blocks of the fallback allocator
+         * and, if built with HEAP_PROFILE, the heap profile to `out`
+         */
+        void print_stats(const StatsWriter& out) const;
 
     private:
+        bool refill(uint8_t index);
+        void *allocate_block(uint8_t index);
         void *fallback_alloc(size_t size, size_t alignment);
+        void fallback_dealloc(void *ptr);
     };
 
 }
@@ -32,4 +32,13 @@ namespace memory {
     void  BumpAllocator::deallocate(void *ptr, size_t size) {
         // do nothing, we leak all allocated memory
     }
+
+    VirtualAddress BumpAllocator::position() const {
+        return next.load();
+    }
+
+    void BumpAllocator::rewind(VirtualAddress position) {
+        ASSERT(position >= heap_start && position <= heap_end, "Position is outside of the heap");
+        next.store(position);
+    }
 }
\ No newline at end of file
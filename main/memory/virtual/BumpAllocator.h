@@ -19,6 +19,11 @@ namespace memory {
         BumpAllocator(VirtualAddress heap_start, VirtualAddress heap_end);
         void *allocate(size_t size, size_t align);
         void  deallocate(void *ptr, size_t size);
+
+        // Address the next allocation starts at (before alignment)
+        VirtualAddress position() const;
+        // Free everything allocated after `position` was taken
+        void rewind(VirtualAddress position);
     };
 
 
@@ -0,0 +1,139 @@
+#include "HeapProfile.h"
+
+#ifdef HEAP_PROFILE
+
+namespace memory {
+
+    static_assert((HEAP_PROFILE_LIVE & (HEAP_PROFILE_LIVE - 1)) == 0, "Live table size must be a power of 2");
+
+    // Fibonacci hashing, spreads aligned addresses over the table
+    inline uint64_t hash(uint64_t value, uint64_t table_size) {
+        return ((value >> 3) * 0x9E37'79B9'7F4A'7C15ULL) >> (64 - __builtin_ctzll(table_size));
+    }
+
+    HeapProfile::HeapProfile(): classes{}, callsites{}, live{}, live_entries(0), untracked(0) {}
+
+    uint16_t HeapProfile::callsite_index(uint64_t caller) {
+        // the last entry collects the callers that did not get one of their own
+        constexpr uint16_t slots = HEAP_PROFILE_CALLSITES - 1;
+        auto index = hash(caller, HEAP_PROFILE_CALLSITES) % slots;
+        for (uint16_t probe = 0; probe < slots; probe++) {
+            auto& site = callsites[index];
+            if (site.caller == caller || site.caller == 0) {
+                site.caller = caller;
+                return index;
+            }
+            index = (index + 1) % slots;
+        }
+        return slots;
+    }
+
+    void HeapProfile::record_allocate(const void *ptr, size_t size, uint8_t size_class, uint64_t caller) {
+        auto site = callsite_index(caller);
+        classes[size_class].allocations++;
+        callsites[site].usage.allocations++;
+
+        // keep one slot empty so that lookups always terminate
+        if (live_entries == HEAP_PROFILE_LIVE - 1) {
+            untracked++;
+            return;
+        }
+        auto address = reinterpret_cast<uint64_t>(ptr);
+        auto index = hash(address, HEAP_PROFILE_LIVE);
+        while (live[index].ptr != 0) {
+            index = (index + 1) & (HEAP_PROFILE_LIVE - 1);
+        }
+        live[index] = Live{address, size, site, size_class};
+        live_entries++;
+
+        classes[size_class].live_count++;
+        classes[size_class].live_bytes += size;
+        callsites[site].usage.live_count++;
+        callsites[site].usage.live_bytes += size;
+    }
+
+    void HeapProfile::record_deallocate(const void *ptr) {
+        auto address = reinterpret_cast<uint64_t>(ptr);
+        auto index = hash(address, HEAP_PROFILE_LIVE);
+        while (live[index].ptr != address) {
+            if (live[index].ptr == 0) {
+                // allocated while the live table was full
+                return;
+            }
+            index = (index + 1) & (HEAP_PROFILE_LIVE - 1);
+        }
+
+        auto& entry = live[index];
+        classes[entry.size_class].live_count--;
+        classes[entry.size_class].live_bytes -= entry.size;
+        callsites[entry.callsite].usage.live_count--;
+        callsites[entry.callsite].usage.live_bytes -= entry.size;
+
+        // Remove the entry by shifting back every following entry of the probe run
+        // that would otherwise no longer be found from its home slot.
+        auto hole = index;
+        auto next = (hole + 1) & (HEAP_PROFILE_LIVE - 1);
+        while (live[next].ptr != 0) {
+            auto home = hash(live[next].ptr, HEAP_PROFILE_LIVE);
+            auto distance_next = (next - home) & (HEAP_PROFILE_LIVE - 1);
+            auto distance_hole = (hole - home) & (HEAP_PROFILE_LIVE - 1);
+            if (distance_hole < distance_next) {
+                live[hole] = live[next];
+                hole = next;
+            }
+            next = (next + 1) & (HEAP_PROFILE_LIVE - 1);
+        }
+        live[hole].ptr = 0;
+        live_entries--;
+    }
+
+    static void print_usage(const StatsWriter& out, const HeapUsage& usage) {
+        out.dec(usage.allocations);
+        out.string(" allocations, ");
+        out.dec(usage.live_count);
+        out.string(" live (");
+        out.dec(usage.live_bytes);
+        out.string(" B)\n");
+    }
+
+    void HeapProfile::print(const StatsWriter& out, const size_t *class_sizes, uint8_t class_count) const {
+        out.string("  Heap profile by size class:\n");
+        for (uint8_t i = 0; i <= class_count && i < HEAP_PROFILE_MAX_CLASSES; i++) {
+            if (classes[i].allocations == 0) {
+                continue;
+            }
+            out.string("    ");
+            if (i < class_count) {
+                out.dec(class_sizes[i]);
+                out.string(" B: ");
+            } else {
+                out.string("fallback: ");
+            }
+            print_usage(out, classes[i]);
+        }
+
+        out.string("  Heap profile by caller:\n");
+        for (uint16_t i = 0; i < HEAP_PROFILE_CALLSITES; i++) {
+            if (callsites[i].usage.allocations == 0) {
+                continue;
+            }
+            out.string("    ");
+            if (i == HEAP_PROFILE_CALLSITES - 1) {
+                out.string("other");
+            } else {
+                out.hex(callsites[i].caller);
+            }
+            out.string(": ");
+            print_usage(out, callsites[i].usage);
+        }
+
+        if (untracked > 0) {
+            out.string("  Untracked allocations (live table full): ");
+            out.dec(untracked);
+            out.string("\n");
+        }
+    }
+
+}
+
+#endif //HEAP_PROFILE
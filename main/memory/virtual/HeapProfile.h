@@ -0,0 +1,67 @@
+#ifndef MAIN_HEAPPROFILE_H
+#define MAIN_HEAPPROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "StatsWriter.h"
+
+/**
+ * Heap instrumentation, only built with HEAP_PROFILE defined (make HEAP_PROFILE=1).
+ *
+ * Records allocation counts and live bytes per size class and per caller, so leaks show
+ * up as callsites whose live bytes only ever grow. Without HEAP_PROFILE the allocators
+ * carry no profile and the record calls disappear.
+ */
+namespace memory {
+
+    // size classes a profile can tell apart, the last one collects fallback allocations
+    constexpr uint8_t HEAP_PROFILE_MAX_CLASSES = 16;
+    // distinct callers, later callers are counted under an "other" entry
+    constexpr uint16_t HEAP_PROFILE_CALLSITES = 64;
+    // live allocations whose caller is remembered until they are freed
+    constexpr uint16_t HEAP_PROFILE_LIVE = 2048;
+
+    struct HeapUsage {
+        uint64_t allocations;
+        uint64_t live_count;
+        uint64_t live_bytes;
+    };
+
+    class HeapProfile {
+        struct Callsite {
+            uint64_t caller;  // 0 = unused
+            HeapUsage usage;
+        };
+
+        struct Live {
+            uint64_t ptr;     // 0 = unused
+            uint64_t size;
+            uint16_t callsite;
+            uint8_t size_class;
+        };
+
+        HeapUsage classes[HEAP_PROFILE_MAX_CLASSES];
+        Callsite callsites[HEAP_PROFILE_CALLSITES];
+        Live live[HEAP_PROFILE_LIVE];
+        uint16_t live_entries;
+        // allocations that were not tracked because the live table was full
+        uint64_t untracked;
+
+        uint16_t callsite_index(uint64_t caller);
+
+    public:
+        HeapProfile();
+
+        void record_allocate(const void *ptr, size_t size, uint8_t size_class, uint64_t caller);
+        void record_deallocate(const void *ptr);
+
+        /**
+         * Write the profile to `out`
+         * @param class_sizes Block size of every class, the class after the last one is printed as fallback
+         */
+        void print(const StatsWriter& out, const size_t *class_sizes, uint8_t class_count) const;
+    };
+
+}
+
+#endif //MAIN_HEAPPROFILE_H
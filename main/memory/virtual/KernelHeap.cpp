@@ -0,0 +1,88 @@
+#include "KernelHeap.h"
+#include "serial.h"
+
+namespace memory {
+
+    void KernelHeap::init(size_t heap_start, size_t heap_size, HeapGrowth growth, size_t max_size) {
+        heap.init(heap_start, heap_size, growth, max_size);
+    }
+
+    void KernelHeap::refill(Magazine &magazine, uint8_t index) {
+        SpinLockGuard lock_guard(lock);
+        while (magazine.count < HEAP_MAGAZINE_BATCH) {
+            auto block = heap.allocate(BLOCK_SIZES[index], BLOCK_SIZES[index]);
+            if (block == nullptr) {
+                break;
+            }
+            magazine.blocks[magazine.count++] = block;
+        }
+    }
+
+    void KernelHeap::drain(Magazine &magazine, uint32_t count) {
+        SpinLockGuard lock_guard(lock);
+        while (count > 0 && magazine.count > 0) {
+            heap.deallocate(magazine.blocks[--magazine.count]);
+            count--;
+        }
+    }
+
+    void *KernelHeap::allocate(size_t size, size_t align) {
+        cpu::InterruptGuard guard;
+#ifndef HEAP_PROFILE
+        auto index = size_index(size, align);
+        if (index.has_value()) {
+            auto& magazine = magazines[cpu::current_id()][index.value()];
+            if (magazine.count == 0) {
+                refill(magazine, index.value());
+                if (magazine.count == 0) {
+                    return nullptr;
+                }
+            }
+            return magazine.blocks[--magazine.count];
+        }
+#endif
+
+        SpinLockGuard lock_guard(lock);
+        return heap.allocate_for(size, align, reinterpret_cast<uint64_t>(__builtin_return_address(0)));
+    }
+
+    void KernelHeap::deallocate(void *ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
+
+        cpu::InterruptGuard guard;
+#ifndef HEAP_PROFILE
+        auto index = heap.size_class_of(ptr);
+        if (index != PAGE_NO_CLASS) {
+            auto& magazine = magazines[cpu::current_id()][index];
+            if (magazine.count == HEAP_MAGAZINE_SIZE) {
+                drain(magazine, HEAP_MAGAZINE_BATCH);
+            }
+            magazine.blocks[magazine.count++] = ptr;
+            return;
+        }
+#endif
+
+        SpinLockGuard lock_guard(lock);
+        heap.deallocate(ptr);
+    }
+
+    void KernelHeap::print_stats() {
+        cpu::InterruptGuard guard;
+        SpinLockGuard lock_guard(lock);
+        heap.print_stats(StatsWriter{serial::write_string});
+
+        serial::write_string("  Cached in magazines:");
+        for (uint8_t i = 0; i < BLOCK_SIZE_COUNT; i++) {
+            uint64_t cached = 0;
+            for (auto& cpu_magazines : magazines) {
+                cached += cpu_magazines[i].count;
+            }
+            serial::write_string(" ");
+            serial::write_dec(cached);
+        }
+        serial::write_string("\n");
+    }
+
+}
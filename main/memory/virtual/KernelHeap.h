@@ -0,0 +1,56 @@
+#ifndef MAIN_KERNELHEAP_H
+#define MAIN_KERNELHEAP_H
+
+#include "BlockAllocator.h"
+#include "runtime/spinlock.h"
+#include "x86/cpu.h"
+
+namespace memory {
+
+    // Blocks a per-CPU magazine holds at most, per size class
+    constexpr uint32_t HEAP_MAGAZINE_SIZE = 32;
+    // Blocks moved between a magazine and the shared heap at once
+    constexpr uint32_t HEAP_MAGAZINE_BATCH = 16;
+
+    /**
+     * The kernel heap: a BlockAllocator shared by all CPUs behind a lock, with a magazine
+     * of free blocks per CPU and size class in front of it.
+     *
+     * Small allocations and frees pop from or push to the magazine of the executing CPU
+     * with interrupts off, and only take the lock to move a batch of blocks between the
+     * magazine and the heap. Allocations above the largest size class always go to the
+     * heap. Blocks cached in magazines are counted as in use by the heap statistics.
+     *
+     * Built with HEAP_PROFILE the magazines are bypassed, so every allocation and free is
+     * recorded with its caller.
+     */
+    class KernelHeap {
+        struct Magazine {
+            uint32_t count;
+            void* blocks[HEAP_MAGAZINE_SIZE];
+        };
+
+        Magazine magazines[cpu::MAX_CPUS][BLOCK_SIZE_COUNT];
+        // protects the heap
+        SpinLock lock;
+        BlockAllocator heap;
+
+        void refill(Magazine &magazine, uint8_t index);
+        void drain(Magazine &magazine, uint32_t count);
+
+    public:
+        KernelHeap(): magazines{}, lock(), heap() {}
+
+        void init(size_t heap_start, size_t heap_size, HeapGrowth growth, size_t max_size);
+        void *allocate(size_t size, size_t align);
+        void deallocate(void *ptr);
+
+        /**
+         * Print the heap statistics and the blocks cached in magazines to the serial port
+         */
+        void print_stats();
+    };
+
+}
+
+#endif //MAIN_KERNELHEAP_H
@@ -0,0 +1,45 @@
+#ifndef MAIN_STATSWRITER_H
+#define MAIN_STATSWRITER_H
+
+#include <stdint.h>
+
+namespace memory {
+
+    /**
+     * Text output of the heap statistics. The allocators also run in user space, where
+     * the serial port is out of reach, so they write through the function they are given:
+     * serial::write_string in the kernel, the WRITE syscall in a process.
+     */
+    struct StatsWriter {
+        void (*write_string)(const char* str);
+
+        void string(const char* str) const { write_string(str); }
+
+        void dec(uint64_t value) const {
+            char buffer[21];
+            int i = sizeof(buffer) - 1;
+            buffer[i] = '\0';
+            do {
+                buffer[--i] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value != 0);
+            write_string(&buffer[i]);
+        }
+
+        void hex(uint64_t value) const {
+            char buffer[19];
+            int i = sizeof(buffer) - 1;
+            buffer[i] = '\0';
+            do {
+                buffer[--i] = "0123456789abcdef"[value & 0xF];
+                value >>= 4;
+            } while (value != 0);
+            buffer[--i] = 'x';
+            buffer[--i] = '0';
+            write_string(&buffer[i]);
+        }
+    };
+
+}
+
+#endif //MAIN_STATSWRITER_H
@@ -0,0 +1,381 @@
+#include "TlsfAllocator.h"
+
+namespace memory {
+
+    // a used block only costs its size word, prev_phys belongs to the previous payload
+    constexpr size_t BLOCK_OVERHEAD = sizeof(size_t);
+    // the payload starts behind the size word
+    constexpr size_t BLOCK_START_OFFSET = sizeof(TlsfBlock*) + sizeof(size_t);
+    // a free block must hold the free list links and the prev_phys of its successor
+    constexpr size_t BLOCK_SIZE_MIN = sizeof(TlsfBlock) - sizeof(TlsfBlock*);
+    constexpr size_t BLOCK_SIZE_MAX = 1ULL << TLSF_FL_MAX;
+
+    // a pool holds one block and the zero-sized sentinel that terminates it
+    constexpr size_t POOL_OVERHEAD = 2 * BLOCK_OVERHEAD;
+
+    void *TlsfBlock::payload() {
+        return reinterpret_cast<uint8_t*>(this) + BLOCK_START_OFFSET;
+    }
+
+    TlsfBlock *TlsfBlock::from_payload(void *ptr) {
+        return reinterpret_cast<TlsfBlock*>(reinterpret_cast<uint8_t*>(ptr) - BLOCK_START_OFFSET);
+    }
+
+    TlsfBlock *TlsfBlock::next() {
+        ASSERT(size() != 0, "Sentinel block has no successor");
+        return reinterpret_cast<TlsfBlock*>(reinterpret_cast<uint8_t*>(payload()) + size() - BLOCK_OVERHEAD);
+    }
+
+    TlsfBlock *TlsfBlock::link_next() {
+        auto next_block = next();
+        next_block->prev_phys = this;
+        return next_block;
+    }
+
+    // index of the highest set bit
+    inline uint8_t fls(size_t value) {
+        return 63 - __builtin_clzll(value);
+    }
+
+    // index of the lowest set bit
+    inline uint8_t ffs(uint32_t value) {
+        return __builtin_ctz(value);
+    }
+
+    /**
+     * The list a block of the given size belongs to
+     */
+    void mapping_insert(size_t size, uint8_t &fl, uint8_t &sl) {
+        if (size < TLSF_SMALL_BLOCK) {
+            fl = 0;
+            sl = size / (TLSF_SMALL_BLOCK / TLSF_SL_COUNT);
+            return;
+        }
+        auto top = fls(size);
+        sl = (size >> (top - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+        fl = top - (TLSF_FL_SHIFT - 1);
+    }
+
+    /**
+     * The first list whose blocks are all at least `size` bytes, so the head of any
+     * non-empty list at or above it fits without searching the list
+     */
+    void mapping_search(size_t size, uint8_t &fl, uint8_t &sl) {
+        if (size >= TLSF_SMALL_BLOCK) {
+            size += (1ULL << (fls(size) - TLSF_SL_LOG2)) - 1;
+        }
+        mapping_insert(size, fl, sl);
+    }
+
+    // round a request up to the block granularity, 0 if it cannot be served
+    size_t adjust_request_size(size_t size, size_t align) {
+        if (size == 0) {
+            return 0;
+        }
+        auto aligned = align_up(size, align);
+        if (aligned < size || aligned >= BLOCK_SIZE_MAX) {
+            return 0;
+        }
+        return aligned < BLOCK_SIZE_MIN ? BLOCK_SIZE_MIN : aligned;
+    }
+
+    bool block_can_split(TlsfBlock *block, size_t size) {
+        return block->size() >= sizeof(TlsfBlock) + size;
+    }
+
+    // cut `block` down to `size` bytes and return the remainder as a new free block
+    TlsfBlock *block_split(TlsfBlock *block, size_t size) {
+        auto remaining = reinterpret_cast<TlsfBlock*>(reinterpret_cast<uint8_t*>(block->payload()) + size - BLOCK_OVERHEAD);
+        auto remaining_size = block->size() - (size + BLOCK_OVERHEAD);
+        ASSERT(reinterpret_cast<size_t>(remaining->payload()) % TLSF_ALIGN == 0, "Remaining block is not aligned");
+        ASSERT(remaining_size >= BLOCK_SIZE_MIN, "Remaining block is too small");
+
+        remaining->size_and_flags = remaining_size;
+        block->set_size(size);
+        remaining->set_free(true);
+        remaining->link_next()->set_prev_free(true);
+        return remaining;
+    }
+
+    // grow `prev` over its physical successor `block`
+    TlsfBlock *block_absorb(TlsfBlock *prev, TlsfBlock *block) {
+        ASSERT(prev->size() != 0, "Cannot absorb into the sentinel block");
+        prev->set_size(prev->size() + block->size() + BLOCK_OVERHEAD);
+        prev->link_next();
+        return prev;
+    }
+
+    TlsfAllocator::TlsfAllocator(): fl_bitmap(0), sl_bitmap{0}, blocks{{nullptr}} {}
+
+    void TlsfAllocator::init(size_t heap_start, size_t heap_size) {
+        add_pool(heap_start, heap_size);
+    }
+
+    void TlsfAllocator::add_pool(size_t pool_start, size_t pool_size) {
+        ASSERT(pool_start % TLSF_ALIGN == 0, "Pool must be aligned to TLSF_ALIGN");
+        ASSERT(pool_size > POOL_OVERHEAD, "Pool too small");
+
+        auto block_size = align_down(pool_size - POOL_OVERHEAD, TLSF_ALIGN);
+        ASSERT(block_size >= BLOCK_SIZE_MIN && block_size < BLOCK_SIZE_MAX, "Pool size out of range");
+
+        // The block header starts one word before the pool, that word is its prev_phys
+        // which is never read because the block does not have a free predecessor.
+        auto block = reinterpret_cast<TlsfBlock*>(pool_start - BLOCK_OVERHEAD);
+        block->size_and_flags = block_size;
+        block->set_free(true);
+        block->set_prev_free(false);
+        block_insert(block);
+
+        // zero-sized used sentinel, stops merging at the end of the pool
+        auto sentinel = block->link_next();
+        sentinel->size_and_flags = 0;
+        sentinel->set_free(false);
+        sentinel->set_prev_free(true);
+    }
+
+    // the sentinel of a pool sits in its last two words
+    TlsfBlock *pool_sentinel(size_t pool_end) {
+        auto sentinel = reinterpret_cast<TlsfBlock*>(pool_end - 2 * BLOCK_OVERHEAD);
+        ASSERT(sentinel->size() == 0 && !sentinel->is_free(), "No sentinel at the end of the pool");
+        return sentinel;
+    }
+
+    void TlsfAllocator::extend_pool(size_t pool_end, size_t size) {
+        ASSERT(pool_end % TLSF_ALIGN == 0 && size % TLSF_ALIGN == 0, "Pool extension must be aligned to TLSF_ALIGN");
+        ASSERT(size >= BLOCK_OVERHEAD + BLOCK_SIZE_MIN, "Pool extension too small");
+
+        // the old sentinel becomes the header of a free block covering the new space
+        auto block = pool_sentinel(pool_end);
+        block->set_size(size - BLOCK_OVERHEAD);
+        block->set_free(true);
+
+        auto sentinel = block->link_next();
+        sentinel->size_and_flags = 0;
+        sentinel->set_free(false);
+        sentinel->set_prev_free(true);
+
+        block = merge_prev(block);
+        ASSERT(block->size() < BLOCK_SIZE_MAX, "Pool grew beyond the largest block");
+        block_insert(block);
+    }
+
+    size_t TlsfAllocator::free_tail(size_t pool_end) {
+        auto sentinel = pool_sentinel(pool_end);
+        if (!sentinel->is_prev_free()) {
+            return 0;
+        }
+        return sentinel->prev_phys->size();
+    }
+
+    void TlsfAllocator::shrink_pool(size_t pool_end, size_t size) {
+        ASSERT(size % TLSF_ALIGN == 0, "Pool shrink must be aligned to TLSF_ALIGN");
+        ASSERT(size + BLOCK_SIZE_MIN <= free_tail(pool_end), "Pool shrink exceeds the free tail");
+
+        auto block = pool_sentinel(pool_end)->prev_phys;
+        block_remove(block);
+        block->set_size(block->size() - size);
+
+        auto sentinel = block->link_next();
+        sentinel->size_and_flags = 0;
+        sentinel->set_free(false);
+        sentinel->set_prev_free(true);
+        block_insert(block);
+    }
+
+    void *TlsfAllocator::allocate(size_t size, size_t align) {
+        if (align < TLSF_ALIGN) {
+            align = TLSF_ALIGN;
+        }
+        ASSERT(is_power_of_2(align), "Alignment must be power of 2");
+
+        auto adjusted = adjust_request_size(size, TLSF_ALIGN);
+        if (adjusted == 0) {
+            return nullptr;
+        }
+
+        // For larger alignments ask for enough space to move the payload to the
+        // next aligned address while leaving a valid free block in front of it.
+        constexpr size_t gap_minimum = sizeof(TlsfBlock);
+        auto search_size = adjusted;
+        if (align > TLSF_ALIGN) {
+            search_size = adjust_request_size(adjusted + align + gap_minimum, align);
+            if (search_size == 0) {
+                return nullptr;
+            }
+        }
+
+        auto block = locate_free(search_size);
+        if (block == nullptr) {
+            return nullptr;
+        }
+
+        auto ptr = reinterpret_cast<size_t>(block->payload());
+        auto aligned = align_up(ptr, align);
+        auto gap = aligned - ptr;
+        if (gap != 0 && gap < gap_minimum) {
+            // the gap cannot hold a block of its own, move on to the next aligned address
+            auto offset = gap_minimum - gap > align ? gap_minimum - gap : align;
+            aligned = align_up(aligned + offset, align);
+            gap = aligned - ptr;
+        }
+        if (gap != 0) {
+            block = trim_free_leading(block, gap);
+        }
+        return prepare_used(block, adjusted);
+    }
+
+    void TlsfAllocator::deallocate(void *ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
+        auto block = TlsfBlock::from_payload(ptr);
+        ASSERT(!block->is_free(), "Block has already been freed");
+
+        block->set_free(true);
+        block->link_next()->set_prev_free(true);
+        block = merge_prev(block);
+        block = merge_next(block);
+        block_insert(block);
+    }
+
+    void TlsfAllocator::free_histogram(uint64_t blocks[TLSF_FL_COUNT], uint64_t bytes[TLSF_FL_COUNT]) const {
+        for (uint8_t fl = 0; fl < TLSF_FL_COUNT; fl++) {
+            blocks[fl] = 0;
+            bytes[fl] = 0;
+            if ((fl_bitmap & (1u << fl)) == 0) {
+                continue;
+            }
+            for (uint8_t sl = 0; sl < TLSF_SL_COUNT; sl++) {
+                for (auto block = this->blocks[fl][sl]; block; block = block->next_free) {
+                    blocks[fl]++;
+                    bytes[fl] += block->size();
+                }
+            }
+        }
+    }
+
+    void TlsfAllocator::insert_free_block(TlsfBlock *block, uint8_t fl, uint8_t sl) {
+        auto current = blocks[fl][sl];
+        block->next_free = current;
+        block->prev_free = nullptr;
+        if (current) {
+            current->prev_free = block;
+        }
+        blocks[fl][sl] = block;
+        fl_bitmap |= 1u << fl;
+        sl_bitmap[fl] |= 1u << sl;
+    }
+
+    void TlsfAllocator::remove_free_block(TlsfBlock *block, uint8_t fl, uint8_t sl) {
+        auto prev = block->prev_free;
+        auto next = block->next_free;
+        if (next) {
+            next->prev_free = prev;
+        }
+        if (prev) {
+            prev->next_free = next;
+            return;
+        }
+
+        // the block was the head of its list
+        blocks[fl][sl] = next;
+        if (next == nullptr) {
+            sl_bitmap[fl] &= ~(1u << sl);
+            if (sl_bitmap[fl] == 0) {
+                fl_bitmap &= ~(1u << fl);
+            }
+        }
+    }
+
+    void TlsfAllocator::block_insert(TlsfBlock *block) {
+        uint8_t fl, sl;
+        mapping_insert(block->size(), fl, sl);
+        insert_free_block(block, fl, sl);
+    }
+
+    void TlsfAllocator::block_remove(TlsfBlock *block) {
+        uint8_t fl, sl;
+        mapping_insert(block->size(), fl, sl);
+        remove_free_block(block, fl, sl);
+    }
+
+    TlsfBlock *TlsfAllocator::find_suitable_block(uint8_t &fl, uint8_t &sl) {
+        // a larger list on the same first level
+        uint32_t sl_map = sl_bitmap[fl] & (~0u << sl);
+        if (sl_map == 0) {
+            // otherwise the smallest list on a larger first level
+            uint32_t fl_map = fl_bitmap & (~0u << (fl + 1));
+            if (fl_map == 0) {
+                return nullptr;
+            }
+            fl = ffs(fl_map);
+            sl_map = sl_bitmap[fl];
+        }
+        sl = ffs(sl_map);
+        return blocks[fl][sl];
+    }
+
+    TlsfBlock *TlsfAllocator::locate_free(size_t size) {
+        uint8_t fl, sl;
+        mapping_search(size, fl, sl);
+        if (fl >= TLSF_FL_COUNT) {
+            return nullptr;
+        }
+
+        auto block = find_suitable_block(fl, sl);
+        if (block) {
+            ASSERT(block->size() >= size, "Free list holds a block that is too small");
+            remove_free_block(block, fl, sl);
+        }
+        return block;
+    }
+
+    void *TlsfAllocator::prepare_used(TlsfBlock *block, size_t size) {
+        trim_free(block, size);
+        block->next()->set_prev_free(false);
+        block->set_free(false);
+        return block->payload();
+    }
+
+    TlsfBlock *TlsfAllocator::merge_prev(TlsfBlock *block) {
+        if (!block->is_prev_free()) {
+            return block;
+        }
+        auto prev = block->prev_phys;
+        ASSERT(prev->is_free(), "Previous block is not free although it is marked so");
+        block_remove(prev);
+        return block_absorb(prev, block);
+    }
+
+    TlsfBlock *TlsfAllocator::merge_next(TlsfBlock *block) {
+        auto next = block->next();
+        if (!next->is_free()) {
+            return block;
+        }
+        block_remove(next);
+        return block_absorb(block, next);
+    }
+
+    void TlsfAllocator::trim_free(TlsfBlock *block, size_t size) {
+        if (!block_can_split(block, size)) {
+            return;
+        }
+        auto remaining = block_split(block, size);
+        block->link_next();
+        remaining->set_prev_free(true);
+        block_insert(remaining);
+    }
+
+    TlsfBlock *TlsfAllocator::trim_free_leading(TlsfBlock *block, size_t size) {
+        if (!block_can_split(block, size)) {
+            return block;
+        }
+        // the leading part stays a free block, the rest is returned
+        auto remaining = block_split(block, size - BLOCK_OVERHEAD);
+        remaining->set_prev_free(true);
+        block->link_next();
+        block_insert(block);
+        return remaining;
+    }
+
+}
@@ -0,0 +1,138 @@
+#ifndef MAIN_TLSFALLOCATOR_H
+#define MAIN_TLSFALLOCATOR_H
+
+#include "VirtualAllocator.h"
+
+namespace memory {
+
+    // Granularity of block sizes and the default alignment of returned pointers
+    constexpr uint8_t TLSF_ALIGN_LOG2 = 3;
+    constexpr size_t TLSF_ALIGN = 1ULL << TLSF_ALIGN_LOG2;
+
+    // Every first level range is split into 2^TLSF_SL_LOG2 second level lists
+    constexpr uint8_t TLSF_SL_LOG2 = 4;
+    constexpr uint8_t TLSF_SL_COUNT = 1 << TLSF_SL_LOG2;
+
+    // Blocks below this size share the first first-level list, split linearly by TLSF_ALIGN
+    constexpr uint8_t TLSF_FL_SHIFT = TLSF_SL_LOG2 + TLSF_ALIGN_LOG2;
+    constexpr size_t TLSF_SMALL_BLOCK = 1ULL << TLSF_FL_SHIFT;
+
+    // Largest block (and pool) the allocator can manage: 4 GiB
+    constexpr uint8_t TLSF_FL_MAX = 32;
+    constexpr uint8_t TLSF_FL_COUNT = TLSF_FL_MAX - TLSF_FL_SHIFT + 1;
+
+    /**
+     * Header in front of every block.
+     *
+     * prev_phys is stored in the last word of the previous block and is only valid
+     * while that block is free. The free list links overlap the payload, so a used
+     * block only costs the size word.
+     */
+    struct TlsfBlock {
+        static constexpr size_t FREE_BIT = 1;
+        static constexpr size_t PREV_FREE_BIT = 2;
+
+        TlsfBlock* prev_phys;
+        // payload size in bytes, the low bits hold FREE_BIT and PREV_FREE_BIT
+        size_t size_and_flags;
+        TlsfBlock* next_free;
+        TlsfBlock* prev_free;
+
+        size_t size() const { return size_and_flags & ~(FREE_BIT | PREV_FREE_BIT); }
+        void set_size(size_t size) { size_and_flags = size | (size_and_flags & (FREE_BIT | PREV_FREE_BIT)); }
+        bool is_free() const { return size_and_flags & FREE_BIT; }
+        void set_free(bool free) { size_and_flags = free ? size_and_flags | FREE_BIT : size_and_flags & ~FREE_BIT; }
+        bool is_prev_free() const { return size_and_flags & PREV_FREE_BIT; }
+        void set_prev_free(bool free) { size_and_flags = free ? size_and_flags | PREV_FREE_BIT : size_and_flags & ~PREV_FREE_BIT; }
+
+        void *payload();
+        static TlsfBlock *from_payload(void *ptr);
+        TlsfBlock *next();
+        TlsfBlock *link_next();
+    };
+
+    /**
+     * Two-level segregated fit allocator.
+     *
+     * Free blocks are kept in segregated lists indexed by a first level (power of 2 range)
+     * and a second level (linear subdivision of that range). One bitmap per level finds a
+     * non-empty list with a single bit scan, so allocate and deallocate run in constant
+     * time regardless of the heap size, which keeps them usable from interrupt handlers.
+     *
+     * Every block carries a boundary tag, so freed blocks are merged with their free
+     * neighbours immediately and the heap does not fragment over time.
+     *
+     * All metadata lives inside the object, the managed memory only holds block headers.
+     */
+    class TlsfAllocator {
+        uint32_t fl_bitmap;
+        uint32_t sl_bitmap[TLSF_FL_COUNT];
+        TlsfBlock* blocks[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+    public:
+        TlsfAllocator();
+
+        /**
+         * Use the given memory as the first pool of the heap
+         */
+        void init(size_t heap_start, size_t heap_size);
+
+        /**
+         * Hand another region of memory to the allocator. Pools are never merged
+         * with each other, a block cannot span two pools.
+         */
+        void add_pool(size_t pool_start, size_t pool_size);
+
+        /**
+         * Grow the pool that ends at `pool_end` by `size` bytes of memory directly behind it.
+         * The new space is merged with a free block at the end of the pool.
+         */
+        void extend_pool(size_t pool_end, size_t size);
+
+        /**
+         * Size of the free block at the end of the pool that ends at `pool_end`, 0 if the
+         * last block is in use
+         */
+        size_t free_tail(size_t pool_end);
+
+        /**
+         * Give `size` bytes at the end of the pool that ends at `pool_end` back, they must
+         * be part of the free tail. The pool keeps at least a minimal free block.
+         */
+        void shrink_pool(size_t pool_end, size_t size);
+
+        /**
+         * Count the free blocks and their bytes per first level, the first level `fl` holds
+         * blocks from 2^(fl + TLSF_FL_SHIFT - 1) bytes (from 0 bytes for fl = 0)
+         */
+        void free_histogram(uint64_t blocks[TLSF_FL_COUNT], uint64_t bytes[TLSF_FL_COUNT]) const;
+
+        /**
+         * Allocate `size` bytes aligned to `align` (power of 2), nullptr if no free block is large enough
+         */
+        void *allocate(size_t size, size_t align);
+
+        /**
+         * Free a block returned by allocate, its size is recorded in the block header
+         */
+        void deallocate(void *ptr);
+
+    private:
+        void insert_free_block(TlsfBlock *block, uint8_t fl, uint8_t sl);
+        void remove_free_block(TlsfBlock *block, uint8_t fl, uint8_t sl);
+        void block_insert(TlsfBlock *block);
+        void block_remove(TlsfBlock *block);
+
+        TlsfBlock *find_suitable_block(uint8_t &fl, uint8_t &sl);
+        TlsfBlock *locate_free(size_t size);
+        void *prepare_used(TlsfBlock *block, size_t size);
+
+        TlsfBlock *merge_prev(TlsfBlock *block);
+        TlsfBlock *merge_next(TlsfBlock *block);
+        void trim_free(TlsfBlock *block, size_t size);
+        TlsfBlock *trim_free_leading(TlsfBlock *block, size_t size);
+    };
+
+}
+
+#endif //MAIN_TLSFALLOCATOR_H
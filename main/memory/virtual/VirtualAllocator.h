@@ -12,10 +12,18 @@
 
 namespace memory {
     constexpr size_t HEAP_START = 0000'001'000'000'0000 + paging::KERNEL_OFFSET;
+    // mapped at boot, the heap grows on demand from there
     constexpr size_t HEAP_SIZE = 100 * 1024; // 100 KiB
+    // virtual window reserved for the kernel heap
+    constexpr size_t HEAP_MAX_SIZE = 512 * 1024 * 1024; // 512 MiB
+
+    // virtual window for vmalloc() and ioremap(). It shares the P4 entry of the kernel image,
+    // which every address space has from the start, so mappings show up in all of them.
+    constexpr size_t VMALLOC_START = 0x0000'0040'0000'0000ULL + paging::KERNEL_OFFSET; // +256 GiB
+    constexpr size_t VMALLOC_SIZE = 128ULL * 1024 * 1024 * 1024; // 128 GiB
 
     // Note: Removed Allocator base class to avoid vtables
-    // BlockAllocator and LinkedListAllocator are now concrete types
+    // BlockAllocator and TlsfAllocator are now concrete types
 
     inline size_t is_power_of_2(size_t size) {
         return size != 0 && (size & (size - 1)) == 0;
@@ -0,0 +1,197 @@
+#include "VmemArena.h"
+
+namespace memory {
+
+    void VmemArena::link(Segment *&list, Segment *segment) {
+        segment->link_prev = nullptr;
+        segment->link_next = list;
+        if (list) {
+            list->link_prev = segment;
+        }
+        list = segment;
+    }
+
+    void VmemArena::unlink(Segment *&list, Segment *segment) {
+        if (segment->link_prev) {
+            segment->link_prev->link_next = segment->link_next;
+        } else {
+            list = segment->link_next;
+        }
+        if (segment->link_next) {
+            segment->link_next->link_prev = segment->link_prev;
+        }
+        segment->link_next = nullptr;
+        segment->link_prev = nullptr;
+    }
+
+    uint16_t VmemArena::bucket_of(VirtualAddress start) {
+        // Fibonacci hashing, the top bits of the product are well mixed
+        return ((start / PAGE_SIZE) * 0x9E3779B97F4A7C15ULL) >> (64 - VMEM_HASH_LOG2);
+    }
+
+    VmemArena::Segment *VmemArena::take_tag() {
+        auto segment = unused;
+        unused = segment->link_next;
+        unused_count--;
+        return segment;
+    }
+
+    void VmemArena::put_tag(Segment *segment) {
+        segment->link_next = unused;
+        unused = segment;
+        unused_count++;
+    }
+
+    void VmemArena::insert_free(Segment *segment) {
+        auto index = 63 - __builtin_clzll(segment->pages);
+        link(free_lists[index], segment);
+        free_map |= 1ULL << index;
+    }
+
+    void VmemArena::remove_free(Segment *segment) {
+        auto index = 63 - __builtin_clzll(segment->pages);
+        unlink(free_lists[index], segment);
+        if (free_lists[index] == nullptr) {
+            free_map &= ~(1ULL << index);
+        }
+    }
+
+    VmemArena::Segment *VmemArena::find_free(uint64_t pages, uint64_t align) {
+        // pages the start may have to move forward to reach the alignment
+        uint64_t slack = align / PAGE_SIZE - 1;
+        uint64_t needed = pages + slack;
+
+        // every segment of a list at or above 2^ceil(log2(needed)) pages fits
+        uint8_t fit = needed == 1 ? 0 : 64 - __builtin_clzll(needed - 1);
+        uint64_t candidates = fit < VMEM_FREE_LISTS ? free_map & (~0ULL << fit) : 0;
+        if (candidates != 0) {
+            return free_lists[__builtin_ctzll(candidates)];
+        }
+
+        // the lists below hold segments that may or may not fit, look at each of them
+        for (int index = 63 - __builtin_clzll(needed); index >= 63 - __builtin_clzll(pages); index--) {
+            for (auto segment = free_lists[index]; segment != nullptr; segment = segment->link_next) {
+                auto start = align_up(segment->start, align);
+                if (start + pages * PAGE_SIZE <= segment->start + segment->pages * PAGE_SIZE) {
+                    return segment;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    VmemArena::Segment *VmemArena::find_allocated(VirtualAddress start) {
+        auto segment = allocated[bucket_of(start)];
+        while (segment != nullptr && segment->start != start) {
+            segment = segment->link_next;
+        }
+        ASSERT(segment != nullptr, "Range was not allocated from this arena");
+        return segment;
+    }
+
+    VmemArena::Segment *VmemArena::split(Segment *segment, uint64_t pages) {
+        auto rest = take_tag();
+        rest->start = segment->start + pages * PAGE_SIZE;
+        rest->pages = segment->pages - pages;
+        rest->free = segment->free;
+        rest->prev = segment;
+        rest->next = segment->next;
+        if (segment->next) {
+            segment->next->prev = rest;
+        }
+        segment->next = rest;
+        segment->pages = pages;
+        return rest;
+    }
+
+    void VmemArena::init(VirtualAddress start, uint64_t size) {
+        ASSERT(start % PAGE_SIZE == 0 && size % PAGE_SIZE == 0 && size > 0, "Arena window must be page aligned");
+        base = start;
+        size_ = size;
+        for (auto& segment : segments) {
+            put_tag(&segment);
+        }
+
+        auto window = take_tag();
+        window->start = start;
+        window->pages = size / PAGE_SIZE;
+        window->prev = nullptr;
+        window->next = nullptr;
+        window->free = true;
+        insert_free(window);
+        free_pages_ = window->pages;
+    }
+
+    rnt::Optional<VirtualAddress> VmemArena::allocate(uint64_t size, uint64_t align) {
+        ASSERT(size % PAGE_SIZE == 0 && size > 0, "Arena allocations must be whole pages");
+        ASSERT(is_power_of_2(align) && align >= PAGE_SIZE, "Arena alignment must be a power of 2 of at least a page");
+        auto pages = size / PAGE_SIZE;
+
+        SpinLockGuard lock_guard(lock);
+        // cutting an allocation out of a free segment takes up to two tags
+        if (unused_count < 2) {
+            return rnt::Optional<VirtualAddress>();
+        }
+        auto segment = find_free(pages, align);
+        if (segment == nullptr) {
+            return rnt::Optional<VirtualAddress>();
+        }
+
+        remove_free(segment);
+        auto lead = (align_up(segment->start, align) - segment->start) / PAGE_SIZE;
+        if (lead > 0) {
+            auto rest = split(segment, lead);
+            insert_free(segment);
+            segment = rest;
+        }
+        if (segment->pages > pages) {
+            insert_free(split(segment, pages));
+        }
+
+        segment->free = false;
+        link(allocated[bucket_of(segment->start)], segment);
+        free_pages_ -= pages;
+        return rnt::Optional<VirtualAddress>(segment->start);
+    }
+
+    uint64_t VmemArena::deallocate(VirtualAddress start) {
+        SpinLockGuard lock_guard(lock);
+        auto segment = find_allocated(start);
+        unlink(allocated[bucket_of(start)], segment);
+
+        auto size = segment->pages * PAGE_SIZE;
+        free_pages_ += segment->pages;
+        segment->free = true;
+
+        // merge with the free neighbours, so the window does not fragment over time
+        if (segment->prev && segment->prev->free) {
+            auto prev = segment->prev;
+            remove_free(prev);
+            prev->pages += segment->pages;
+            prev->next = segment->next;
+            if (segment->next) {
+                segment->next->prev = prev;
+            }
+            put_tag(segment);
+            segment = prev;
+        }
+        if (segment->next && segment->next->free) {
+            auto next = segment->next;
+            remove_free(next);
+            segment->pages += next->pages;
+            segment->next = next->next;
+            if (next->next) {
+                next->next->prev = segment;
+            }
+            put_tag(next);
+        }
+        insert_free(segment);
+        return size;
+    }
+
+    uint64_t VmemArena::size_of(VirtualAddress start) {
+        SpinLockGuard lock_guard(lock);
+        return find_allocated(start)->pages * PAGE_SIZE;
+    }
+
+}
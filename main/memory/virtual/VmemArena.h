@@ -0,0 +1,107 @@
+#ifndef MAIN_VMEMARENA_H
+#define MAIN_VMEMARENA_H
+
+#include "VirtualAllocator.h"
+#include "runtime/optional.h"
+#include "runtime/spinlock.h"
+
+namespace memory {
+
+    // Boundary tags an arena owns, every allocation and every free gap between them takes one
+    constexpr uint16_t VMEM_MAX_SEGMENTS = 512;
+    // Free list n holds free segments of 2^n to 2^(n+1) - 1 pages
+    constexpr uint8_t VMEM_FREE_LISTS = 64;
+    // Buckets of the hash table that finds allocated segments by address
+    constexpr uint8_t VMEM_HASH_LOG2 = 6;
+    constexpr uint16_t VMEM_HASH_BUCKETS = 1 << VMEM_HASH_LOG2;
+
+    /**
+     * Allocator for page aligned ranges of a virtual address window, after the vmem
+     * resource allocator.
+     *
+     * The window is cut into segments, each described by a boundary tag from a fixed pool
+     * and linked to its neighbours in address order. Free segments are kept in one list
+     * per power of 2 size with a bitmap of the non-empty lists. Allocation takes the first
+     * segment of the smallest list whose segments all fit (instant fit), so it is a bit
+     * scan instead of a search; only if no such list exists is the list below searched.
+     * Allocated segments are found by their start address through a hash table, so
+     * freeing only needs the address and merges the segment with its free neighbours
+     * right away.
+     *
+     * The arena manages addresses only, nothing is mapped or written in the window. All
+     * metadata lives inside the object, so arenas work without the kernel heap.
+     */
+    class VmemArena {
+        struct Segment {
+            VirtualAddress start;
+            uint64_t pages;
+            // neighbours in address order, every segment of the window is on this list
+            Segment* prev;
+            Segment* next;
+            // free list of the size class while free, hash chain while allocated,
+            // list of unused tags while the tag describes no range
+            Segment* link_prev;
+            Segment* link_next;
+            bool free;
+        };
+
+        Segment segments[VMEM_MAX_SEGMENTS];
+        Segment* unused;
+        uint16_t unused_count;
+        Segment* free_lists[VMEM_FREE_LISTS];
+        // bit n set = free_lists[n] is not empty
+        uint64_t free_map;
+        Segment* allocated[VMEM_HASH_BUCKETS];
+        VirtualAddress base;
+        uint64_t size_;
+        uint64_t free_pages_;
+        SpinLock lock;
+
+        static void link(Segment *&list, Segment *segment);
+        static void unlink(Segment *&list, Segment *segment);
+        static uint16_t bucket_of(VirtualAddress start);
+
+        Segment *take_tag();
+        void put_tag(Segment *segment);
+        void insert_free(Segment *segment);
+        void remove_free(Segment *segment);
+        Segment *find_free(uint64_t pages, uint64_t align);
+        Segment *find_allocated(VirtualAddress start);
+        Segment *split(Segment *segment, uint64_t pages);
+
+    public:
+        VmemArena(): segments{}, unused(nullptr), unused_count(0), free_lists{}, free_map(0), allocated{},
+                     base(0), size_(0), free_pages_(0), lock() {}
+
+        /**
+         * Manage the page aligned window `start` - `start + size`
+         */
+        void init(VirtualAddress start, uint64_t size);
+
+        /**
+         * Reserve `size` bytes (multiple of PAGE_SIZE) aligned to `align` (power of 2, at
+         * least PAGE_SIZE), empty if the window has no large enough gap or no tag is left
+         */
+        rnt::Optional<VirtualAddress> allocate(uint64_t size, uint64_t align = PAGE_SIZE);
+
+        /**
+         * Release a range returned by allocate
+         * @return The size of the range in bytes
+         */
+        uint64_t deallocate(VirtualAddress start);
+
+        /**
+         * Size in bytes of a range returned by allocate
+         */
+        uint64_t size_of(VirtualAddress start);
+
+        bool contains(VirtualAddress address) const {
+            return address >= base && address - base < size_;
+        }
+
+        uint64_t free_size() const { return free_pages_ * PAGE_SIZE; }
+    };
+
+}
+
+#endif //MAIN_VMEMARENA_H
@@ -0,0 +1,96 @@
+#include "vmalloc.h"
+
+#include "VmemArena.h"
+#include "memory/frame_allocator.h"
+#include "memory/memory.h"
+
+namespace memory {
+
+    static VmemArena vmalloc_arena;
+
+    static paging::PageFlags caching_flags(Caching caching) {
+        paging::PageFlags flags{.writable = true, .no_execute = true, .global = true};
+        switch (caching) {
+            case Caching::WRITE_BACK:
+                break;
+            case Caching::WRITE_THROUGH:
+                flags.write_through = true;
+                break;
+            case Caching::WRITE_COMBINING:
+                flags.write_combining = true;
+                break;
+            case Caching::UNCACHED:
+                // PCD and PWT select PAT entry 3, strong uncacheable
+                flags.no_cache = true;
+                flags.write_through = true;
+                break;
+        }
+        return flags;
+    }
+
+    void init_vmalloc() {
+        vmalloc_arena.init(VMALLOC_START, VMALLOC_SIZE);
+    }
+
+    void *vmalloc(size_t size) {
+        auto pages = align_up(size, PAGE_SIZE) / PAGE_SIZE;
+        ASSERT(pages > 0, "vmalloc of 0 bytes");
+        auto start = vmalloc_arena.allocate((pages + 1) * PAGE_SIZE);
+        if (start.is_empty()) {
+            return nullptr;
+        }
+
+        // map_range takes whatever runs of frames are left, down to single frames, and
+        // leaves nothing behind if even those run out
+        auto& page_table = paging::ActivePageTable::instance();
+        if (!page_table.map_range(paging::Page::containing_address(start.value()), pages,
+                                  paging::PageFlags{.writable = true, .no_execute = true, .global = true}, *frame_allocator)) {
+            vmalloc_arena.deallocate(start.value());
+            return nullptr;
+        }
+        return reinterpret_cast<void*>(start.value());
+    }
+
+    void vfree(void *ptr) {
+        auto start = reinterpret_cast<VirtualAddress>(ptr);
+        ASSERT(vmalloc_arena.contains(start), "Pointer was not returned by vmalloc");
+        // the range is released after the unmap, so nobody maps it again in between
+        auto pages = vmalloc_arena.size_of(start) / PAGE_SIZE - 1;
+        auto& page_table = paging::ActivePageTable::instance();
+        page_table.unmap_range(paging::Page::containing_address(start), pages, *frame_allocator);
+        vmalloc_arena.deallocate(start);
+    }
+
+    void *ioremap(PhysicalAddress phys, size_t size, Caching caching) {
+        auto offset = phys % PAGE_SIZE;
+        auto frame = Frame::containing_address(phys);
+        auto pages = align_up(offset + size, PAGE_SIZE) / PAGE_SIZE;
+        ASSERT(size > 0, "ioremap of 0 bytes");
+
+        // a 2 MiB aligned start lets map_range_to use huge pages for 2 MiB aligned devices
+        auto align = frame.number % paging::HUGE_2M_PAGES == 0 && pages >= paging::HUGE_2M_PAGES
+                     ? paging::HUGE_2M_PAGES * PAGE_SIZE : PAGE_SIZE;
+        auto start = vmalloc_arena.allocate((pages + 1) * PAGE_SIZE, align);
+        if (start.is_empty()) {
+            return nullptr;
+        }
+
+        auto& page_table = paging::ActivePageTable::instance();
+        if (!page_table.map_range_to(paging::Page::containing_address(start.value()), frame, pages,
+                                     caching_flags(caching), *frame_allocator)) {
+            vmalloc_arena.deallocate(start.value());
+            return nullptr;
+        }
+        return reinterpret_cast<void*>(start.value() + offset);
+    }
+
+    void iounmap(void *ptr) {
+        auto start = align_down(reinterpret_cast<VirtualAddress>(ptr), PAGE_SIZE);
+        ASSERT(vmalloc_arena.contains(start), "Pointer was not returned by ioremap");
+        auto pages = vmalloc_arena.size_of(start) / PAGE_SIZE - 1;
+        auto& page_table = paging::ActivePageTable::instance();
+        page_table.unmap_range(paging::Page::containing_address(start), pages, *frame_allocator, false);
+        vmalloc_arena.deallocate(start);
+    }
+
+}
@@ -0,0 +1,56 @@
+#ifndef MAIN_VMALLOC_H
+#define MAIN_VMALLOC_H
+
+#include <stddef.h>
+
+#include "paging/physmap.h"
+
+/**
+ * Kernel mappings allocated out of the vmalloc window (VMALLOC_START) instead of fixed
+ * addresses. Every area is followed by an unmapped guard page, so running off its end
+ * faults instead of corrupting the next area.
+ */
+namespace memory {
+
+    // Memory type of an ioremap() mapping
+    enum class Caching {
+        WRITE_BACK,       // ordinary RAM
+        WRITE_THROUGH,
+        WRITE_COMBINING,  // framebuffers and other write-mostly buffers
+        UNCACHED,         // device registers
+    };
+
+    /**
+     * Set up the vmalloc window, once the kernel runs at high addresses
+     */
+    void init_vmalloc();
+
+    /**
+     * Map `size` bytes of virtually contiguous kernel memory. The frames behind it are not
+     * physically contiguous, so large buffers do not depend on fragmentation. The memory
+     * is not cleared.
+     * @return nullptr if the window or physical memory is exhausted
+     */
+    void *vmalloc(size_t size);
+
+    /**
+     * Unmap memory returned by vmalloc and free its frames
+     */
+    void vfree(void *ptr);
+
+    /**
+     * Map `size` bytes of device memory at `phys` with the given memory type. The frames
+     * are not taken from the frame allocator and stay with the device.
+     * @return The address of `phys`, nullptr if the window is exhausted or there is no
+     *         memory for the page tables
+     */
+    void *ioremap(PhysicalAddress phys, size_t size, Caching caching);
+
+    /**
+     * Remove a mapping returned by ioremap
+     */
+    void iounmap(void *ptr);
+
+}
+
+#endif //MAIN_VMALLOC_H
@@ -37,6 +37,8 @@ public:
         DIRTY          = 1 << 6,   // Page was written to (only for P1)
         HUGE           = 1 << 7,   // Huge page (2MB in P2, 1GB in P3)
         GLOBAL         = 1 << 8,   // Global page (not flushed on TLB invalidation)
+        PAT            = 1 << 7,   // Page attribute table index bit (only for P1, same bit as HUGE)
+        PAT_HUGE       = 1 << 12,  // Page attribute table index bit of huge pages
         NO_EXECUTE     = 1ULL << 63 // Disable execution
     };
 
@@ -65,6 +67,11 @@ public:
         return entry & 0x000FFFFFFFFFF000ULL;
     }
 
+    // Physical address of a huge page, bit 12 is the PAT bit there
+    PhysicalAddress get_huge_address() const {
+        return entry & 0x000FFFFFFFFFE000ULL;
+    }
+
     rnt::Optional<memory::Frame> get_frame() const {
         if (is_present()) {
             return memory::Frame::containing_address(get_address());
@@ -81,6 +88,19 @@ public:
         entry = (addr & 0x000FFFFFFFFFF000ULL) | (flags & 0xFFF0000000000FFFULL);
     }
 
+    // Bits 52-61 are ignored by the CPU in entries that point to a table. The mapper counts
+    // the used entries of that table there, so it can free the table once it is empty.
+    static constexpr uint8_t USED_ENTRIES_SHIFT = 52;
+    static constexpr uint64_t USED_ENTRIES_MASK = 0x3FFULL << USED_ENTRIES_SHIFT;
+
+    uint16_t used_entries() const {
+        return (entry & USED_ENTRIES_MASK) >> USED_ENTRIES_SHIFT;
+    }
+
+    void set_used_entries(uint16_t count) {
+        entry = (entry & ~USED_ENTRIES_MASK) | (static_cast<uint64_t>(count) << USED_ENTRIES_SHIFT);
+    }
+
     // Get raw value
     uint64_t get_raw() const { return entry; }
     void set_raw(uint64_t value) { entry = value; }
@@ -32,9 +32,9 @@ void Table<Level>::print(VgaOutStream& stream, int recursive_level, int indent)
         stream << level_name(Level) << "[" << (uint32_t)i << "]: ";
         entry.print(stream);
 
-        // Check if this is the recursive entry (P4[511] -> P4)
+        // Check if this is the recursive entry of the boot table (P4[511] -> P4)
         if constexpr (Level == 4) {
-            if (i == RECURSIVE_INDEX) {
+            if (entry.get_address() == get_physical_address()) {
                 stream << " ->P4 (recursive)";
                 stream << VgaOutStream::endl;
                 continue;
@@ -9,20 +9,13 @@
 #include <stddef.h>
 
 #include "panic.h"
+#include "physmap.h"
 #include "memory/frame_allocator.h"
 
 class VgaOutStream;
 
 namespace paging {
 
-// Recursive page table constants
-// With P4[511] pointing to P4 itself, we can access all page tables through these addresses
-constexpr uint64_t RECURSIVE_INDEX = 511;
-constexpr uint64_t RECURSIVE_P4_ADDR = 0xFFFF'FFFF'FFFF'F000ULL;  // [511,511,511,511]
-constexpr uint64_t RECURSIVE_P3_BASE = 0xFFFF'FFFF'FFE0'0000ULL;  // [511,511,511,X]
-constexpr uint64_t RECURSIVE_P2_BASE = 0xFFFF'FFC0'0000'0000ULL;  // [511,511,X,Y]
-constexpr uint64_t RECURSIVE_P1_BASE = 0xFFFF'8000'0000'0000ULL;  // [511,X,Y,Z]
-
 // Simple enable_if implementation for freestanding environment
 template<bool B, typename T = void>
 struct enable_if {};
@@ -94,10 +87,10 @@ public:
 
     // Get physical address of this table
     uint64_t get_physical_address() const {
-        return reinterpret_cast<uint64_t>(this);
+        return virt_to_phys(this);
     }
 
-    // Get next level table using recursive mapping - only available for P4, P3, P2
+    // Get next level table through the physmap - only available for P4, P3, P2
     // P1 doesn't have this method (compile error if you try to call it)
     // Two versions: non-const returns mutable pointer, const returns const pointer
     template<int L = Level>
@@ -106,7 +99,7 @@ public:
         if (!entries[index].is_present() || entries[index].is_huge()) {
             return nullptr;
         }
-        return reinterpret_cast<Table<L - 1>*>(next_table_address(index));
+        return phys_to_virt<Table<L - 1>>(entries[index].get_address());
     }
 
     template<int L = Level>
@@ -115,7 +108,7 @@ public:
         if (!entries[index].is_present() || entries[index].is_huge()) {
             return nullptr;
         }
-        return reinterpret_cast<const Table<L - 1>*>(next_table_address(index));
+        return phys_to_virt<const Table<L - 1>>(entries[index].get_address());
     }
 
     // Get or create next level table - allocates a frame if entry is not present
@@ -127,8 +120,8 @@ public:
             return get_next_table<L>(index);
         }
 
-        // Allocate a new frame for the table
-        auto frame = allocator.allocate_frame();
+        // Allocate a zeroed frame for the table, an empty table is all zeros
+        auto frame = allocator.allocate_zeroed_frame();
         if (frame.is_empty()) {
             return nullptr;
         }
@@ -138,26 +131,13 @@ public:
         // USER bit is required for ring 3 to traverse page table hierarchy
         entries[index].set(f.start_address(), Entry::PRESENT | Entry::WRITABLE | Entry::USER);
 
-        // Get the newly created table and zero it
-        auto table = reinterpret_cast<Table<L - 1>*>(next_table_address(index));
-        table->clear();
-
-        return table;
+        return phys_to_virt<Table<L - 1>>(f.start_address());
     }
 
     // Print table entries
     // recursive_level: 0 = current level only, 1 = one level down, -1 = all levels
     void print(VgaOutStream& stream, int recursive_level = 0, int indent = 0) const;
 
-private:
-    // Calculate next level table address using recursive page table mapping
-    // Shift current address left by 9 bits (drops highest index, adds space for new index)
-    // OR with index << 12 (adds the new index in the page offset position)
-    uint64_t next_table_address(size_t index) const {
-        uint64_t table_address = reinterpret_cast<uint64_t>(this);
-        return (table_address << 9) | (index << 12);
-    }
-
 } __attribute__((aligned(4096)));
 
 // Verify size for each instantiation
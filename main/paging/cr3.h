@@ -12,21 +12,36 @@
  * CR3 holds the physical address of the P4 (PML4) page table
  */
 namespace cr3 {
-    /**
-     * Get the current P4 table from CR3
-     * With recursive page tables, P4 is always accessible at the recursive address
-     * @return Pointer to the current P4 table
-     */
-    inline paging::P4Table* get_virt_p4_table() {
-        // With P4[511] pointing to P4 itself, we can access P4 at [511,511,511,511]
-        return reinterpret_cast<paging::P4Table*>(paging::RECURSIVE_P4_ADDR);
-    }
+    // With CR4.PCIDE set, bits 0-11 hold the PCID of the address space
+    constexpr uint64_t PCID_MASK = 0xFFF;
+    // Keep the TLB entries of the new PCID when loading CR3 (only with CR4.PCIDE)
+    constexpr uint64_t NO_FLUSH = 1ULL << 63;
 
-    inline PhysicalAddress get_phys_addr() {
+    inline uint64_t read() {
         uint64_t cr3_value;
         asm volatile("mov %%cr3, %0" : "=r"(cr3_value));
+        return cr3_value;
+    }
+
+    inline void write(uint64_t value) {
+        asm volatile("mov %0, %%cr3" : : "r"(value) : "memory");
+    }
+
+    inline PhysicalAddress get_phys_addr() {
         // CR3 bits 12-51 contain the physical address of P4 table
-        return cr3_value & 0x000FFFFFFFFFF000ULL;
+        return read() & 0x000FFFFFFFFFF000ULL;
+    }
+
+    inline uint16_t get_pcid() {
+        return read() & PCID_MASK;
+    }
+
+    /**
+     * Get the current P4 table from CR3
+     * @return Pointer to the current P4 table inside the physmap
+     */
+    inline paging::P4Table* get_virt_p4_table() {
+        return paging::phys_to_virt<paging::P4Table>(get_phys_addr());
     }
 
     inline memory::Frame get_frame() {
@@ -34,7 +49,7 @@ namespace cr3 {
     }
 
     /**
-     * Set the physical address to a new P4 Table
+     * Set the physical address to a new P4 Table (with PCID 0)
      * This will flush the TLB (Translation Lookaside Buffer)
      * @param phys_addr Physical address of the new P4 table
      */
@@ -42,14 +57,14 @@ namespace cr3 {
         uint64_t addr = phys_addr;
         // Ensure the address is page-aligned
         addr &= 0x000FFFFFFFFFF000ULL;
-        asm volatile("mov %0, %%cr3" : : "r"(addr) : "memory");
+        write(addr);
     }
 
     /**
-     * Reload CR3 to flush the TLB
+     * Reload CR3 to flush the non-global TLB entries of the current PCID
      */
     inline void flush() {
-        set_phys_addr(get_phys_addr());
+        write(read());
     }
 }
 
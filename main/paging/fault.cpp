@@ -0,0 +1,73 @@
+#include "fault.h"
+#include "memory/memory.h"
+
+namespace paging {
+
+    void DemandRegions::add(VirtualAddress start, uint64_t size, PageFlags flags) {
+        ASSERT(start % PAGE_SIZE == 0 && size % PAGE_SIZE == 0, "Demand region must be page aligned");
+        // a read-only region could never hold anything but zeros
+        ASSERT(flags.writable, "Demand region must be writable");
+
+        for (uint64_t i = 0; i < count; i++) {
+            ASSERT(start + size <= regions[i].start || start >= regions[i].end, "Demand regions must not overlap");
+        }
+
+        ASSERT(count < MAX_DEMAND_REGIONS, "Too many demand regions");
+        regions[count++] = DemandRegion{start, start + size, flags};
+    }
+
+    void DemandRegions::set_end(VirtualAddress start, VirtualAddress end) {
+        for (uint64_t i = 0; i < count; i++) {
+            if (regions[i].start == start) {
+                ASSERT(end >= start, "Demand region cannot end before its start");
+                regions[i].end = end;
+                return;
+            }
+        }
+        PANIC("No demand region starts at this address");
+    }
+
+    const DemandRegion* DemandRegions::find(VirtualAddress address) const {
+        for (uint64_t i = 0; i < count; i++) {
+            if (address >= regions[i].start && address < regions[i].end) {
+                return &regions[i];
+            }
+        }
+        return nullptr;
+    }
+
+    bool handle_page_fault(const DemandRegions& regions, VirtualAddress address, uint64_t code) {
+        // protection violations and corrupted tables are never resolvable
+        if (code & (fault_code::PRESENT | fault_code::RESERVED)) {
+            return false;
+        }
+
+        auto region = regions.find(address);
+        if (region == nullptr) {
+            return false;
+        }
+        // The kernel may touch user regions itself, syscalls read their arguments from
+        // there. User code only gets the regions it is allowed to access.
+        if ((code & fault_code::USER) && !region->flags.user_accessible) {
+            return false;
+        }
+        if ((code & fault_code::INSTRUCTION) && region->flags.no_execute) {
+            return false;
+        }
+
+        // hand out zeroed memory only, the frame may still contain data of its previous owner
+        auto frame = memory::frame_allocator->allocate_zeroed_frame();
+        if (frame.is_empty()) {
+            return false;
+        }
+
+        // The page was not present, so there is no stale TLB entry to invalidate
+        auto page = Page::containing_address(address);
+        if (!ActivePageTable::instance().map_to(page, frame.value(), region->flags, *memory::frame_allocator)) {
+            // no memory left for a page table
+            memory::frame_allocator->deallocate_frame(frame.value());
+            return false;
+        }
+        return true;
+    }
+}
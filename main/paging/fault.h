@@ -0,0 +1,74 @@
+#ifndef MAIN_FAULT_H
+#define MAIN_FAULT_H
+
+#include <stdint.h>
+#include "paging.h"
+
+namespace paging {
+
+    /**
+     * Bits of the error code the CPU pushes for a page fault
+     */
+    namespace fault_code {
+        constexpr uint64_t PRESENT = 1 << 0;      // 0: page not present, 1: protection violation
+        constexpr uint64_t WRITE = 1 << 1;        // the access was a write
+        constexpr uint64_t USER = 1 << 2;         // the access came from ring 3
+        constexpr uint64_t RESERVED = 1 << 3;     // a reserved bit was set in a paging structure
+        constexpr uint64_t INSTRUCTION = 1 << 4;  // the access was an instruction fetch
+    }
+
+    /**
+     * A range of virtual memory that is backed on demand.
+     * Nothing is mapped up front, the first access to a page faults and the
+     * fault handler maps a zeroed frame there.
+     */
+    struct DemandRegion {
+        VirtualAddress start;
+        VirtualAddress end;
+        PageFlags flags;
+    };
+
+    constexpr uint64_t MAX_DEMAND_REGIONS = 8;
+
+    /**
+     * The demand paged regions of one address space
+     */
+    class DemandRegions {
+        DemandRegion regions[MAX_DEMAND_REGIONS];
+        uint64_t count;
+
+    public:
+        DemandRegions(): regions{}, count(0) {}
+
+        /**
+         * Register a demand paged region
+         * @param start Page aligned start address
+         * @param size Size in bytes (multiple of PAGE_SIZE)
+         * @param flags Flags the pages are mapped with, must be writable
+         */
+        void add(VirtualAddress start, uint64_t size, PageFlags flags);
+
+        /**
+         * Move the end of the region that starts at `start`, e.g. to the heap break.
+         * Pages above the new end fault like any other unmapped page.
+         */
+        void set_end(VirtualAddress start, VirtualAddress end);
+
+        /**
+         * The region that contains `address`, nullptr if there is none
+         */
+        const DemandRegion* find(VirtualAddress address) const;
+    };
+
+    /**
+     * Try to resolve a page fault
+     * @param regions The demand paged regions of the active address space
+     * @param address The faulting address (CR2)
+     * @param code The error code pushed by the CPU
+     * @return true if the page has been mapped and the faulting instruction can be restarted,
+     *         false if the fault is fatal
+     */
+    bool handle_page_fault(const DemandRegions& regions, VirtualAddress address, uint64_t code);
+}
+
+#endif //MAIN_FAULT_H
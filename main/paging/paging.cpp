@@ -6,84 +6,254 @@
 #include "Table.h"
 #include "Entry.h"
 #include "cr3.h"
+#include "tlb.h"
 #include "panic.h"
 #include "vga.hpp"
 #include "memory/frame.h"
 #include "gdt.hpp"
 #include "idt.hpp"
+#include "x86/cpuid.h"
+#include "x86/regs.h"
+#include "runtime/string.h"
 
 namespace paging {
 
+    /**
+     * Whether the 2 MiB window starting at `start` overlaps RAM that the physmap covers.
+     * ACPI reclaimable memory is included, so that it can be handed to the frame
+     * allocator later without mapping it first.
+     */
+    static bool window_has_ram(const Multiboot2TagMmap* mmap, PhysicalAddress start) {
+        auto end = start + HUGE_2M_PAGES * PAGE_SIZE;
+        for (auto area = mmap->entries_begin(); area != mmap->entries_end(); ++area) {
+            if (!area->is_available() && !area->is_acpi_reclaimable()) {
+                continue;
+            }
+            if (area->addr < end && area->addr + area->len > start) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Legacy VGA memory and option/BIOS ROMs, device memory inside the first 2 MiB window
+    constexpr PhysicalAddress LEGACY_HOLE_START = 0xA0000;
+    constexpr PhysicalAddress LEGACY_HOLE_END = 0x100000;
+
     template<typename Allocator>
-    void remap_the_kernel(Allocator &allocator, BootInfo &boot_info) {
+    void init_physmap(Allocator& allocator, BootInfo& boot_info) {
         auto& out = vga::out();
-        auto temp_raw_page = Page(0xcafebabe);
-        auto temp_page = TemporaryPage(temp_raw_page, allocator);
+        auto mmap = boot_info.get_memory_map();
 
-        auto active_table = ActivePageTable::instance();
-        active_table.print(out, 1);
-        temp_raw_page.debug_print(out);
-        auto new_table_frame = allocator.allocate_frame().expect("Out of memory");
-        auto new_table = InactivePageTable(new_table_frame, active_table, temp_page);
+        PhysicalAddress ram_end = 0;
+        for (auto area = mmap->entries_begin(); area != mmap->entries_end(); ++area) {
+            if ((area->is_available() || area->is_acpi_reclaimable()) && area->addr + area->len > ram_end) {
+                ram_end = area->addr + area->len;
+            }
+        }
+        if (ram_end > memory::AreaFrameAllocator::MAX_PHYSICAL_MEMORY) {
+            ram_end = memory::AreaFrameAllocator::MAX_PHYSICAL_MEMORY;
+        }
 
+        // Until the physmap exists, tables are only reachable through the boot identity
+        // mapping, so all of them are allocated below its limit.
+        auto allocate_table = [&allocator]() {
+            auto frame = allocator.allocate_frames(1, PAGE_SIZE, BOOT_IDENTITY_LIMIT).expect("Out of memory");
+            auto table = reinterpret_cast<P2Table*>(frame.start_address());
+            table->clear();
+            return frame;
+        };
+
+        auto boot_p4 = reinterpret_cast<P4Table*>(cr3::get_phys_addr());
+        ASSERT((*boot_p4)[PHYSMAP_P4_INDEX].is_unused(), "Physmap slot already in use");
+        auto p3_frame = allocate_table();
+        auto p3 = reinterpret_cast<P3Table*>(p3_frame.start_address());
+
+        // Map every 2 MiB window that contains RAM. Windows of memory mapped devices stay
+        // unmapped, so the physmap never aliases them with a different cache type. The
+        // first window also holds the legacy VGA and ROM range, it is mapped with 4 KiB
+        // pages around that hole.
+        auto flags = PageFlags{.writable = true, .no_execute = true, .global = true};
+        uint64_t windows = 0;
+        for (PhysicalAddress addr = 0; addr < ram_end; addr += HUGE_2M_PAGES * PAGE_SIZE) {
+            if (!window_has_ram(mmap, addr)) {
+                continue;
+            }
+            auto page = Page::containing_address(phys_to_virt(addr));
+            Entry& p3_entry = (*p3)[page.p3_index()];
+            if (p3_entry.is_unused()) {
+                p3_entry.set(allocate_table().start_address(), Entry::PRESENT | Entry::WRITABLE | Entry::NO_EXECUTE);
+            }
+            auto p2 = reinterpret_cast<P2Table*>(p3_entry.get_address());
+            windows++;
+            if (addr >= LEGACY_HOLE_END) {
+                (*p2)[page.p2_index()].set(addr, flags.to_raw_huge());
+                continue;
+            }
 
-        active_table.with(new_table, temp_page, [&boot_info, &allocator, &out](ActivePageTable& map) {
-            // Map kernel ELF sections at BOTH identity (low) and higher-half (high) addresses
-            auto elf = boot_info.get_elf_sections().expect("Elf sections required");
-            for (auto section = elf->sections_begin(); section != elf->sections_end(); ++section) {
-                if (!section->is_allocated()) {
-                    continue;
-                }
-                ASSERT(section->addr % PAGE_SIZE == 0, "Elf sections must be page alined");
-                out << "mapping section " << elf->get_section_name(section) << " at addr: " << hex << section->addr << ", size: " << size << section->size << out.endl;
-                auto flags = PageFlags::from_elf_section(*section);
-
-                auto start_frame = memory::Frame::containing_address(section->addr);
-                auto end_frame = memory::Frame::containing_address(section->addr + section->size - 1);
-                for (uint64_t i = start_frame.number; i <= end_frame.number; ++i) {
-                    auto frame = memory::Frame(i);
-                    // Identity map (low address)
-                    map.identity_map(frame, flags, allocator);
-                    // Also map to higher-half (high address)
-                    auto high_page = Page::containing_address(frame.start_address() + KERNEL_OFFSET);
-                    map.map_to(high_page, frame, flags, allocator);
+            auto p1_frame = allocate_table();
+            auto p1 = reinterpret_cast<P1Table*>(p1_frame.start_address());
+            for (uint16_t i = 0; i < P1Table::ENTRY_COUNT; i++) {
+                auto frame_addr = addr + i * PAGE_SIZE;
+                if (frame_addr < LEGACY_HOLE_START || frame_addr >= LEGACY_HOLE_END) {
+                    (*p1)[i].set(frame_addr, flags.to_raw());
                 }
             }
+            (*p2)[page.p2_index()].set(p1_frame.start_address(), Entry::PRESENT | Entry::WRITABLE | Entry::NO_EXECUTE);
+        }
 
-            // Map multiboot information at both low and high addresses
-            auto multiboot_start = reinterpret_cast<uint64_t>(&boot_info);
-            auto multiboot_end   = multiboot_start + boot_info.get_total_size();
-            auto start_frame = memory::Frame::containing_address(multiboot_start);
-            auto end_frame = memory::Frame::containing_address(multiboot_end);
-            for (uint64_t i = start_frame.number; i <= end_frame.number; ++i) {
-                auto frame = memory::Frame(i);
-                if (map.translate(frame.start_address()).has_value()) {
-                    // already mapped as part of kernel
-                    continue;
-                }
-                // Identity map
-                map.identity_map(frame, PageFlags {}, allocator);
-                // Also map to higher-half
-                auto high_page = Page::containing_address(frame.start_address() + KERNEL_OFFSET);
-                map.map_to(high_page, frame, PageFlags {}, allocator);
+        // the slot was empty before, so there is nothing to invalidate
+        (*boot_p4)[PHYSMAP_P4_INDEX].set(p3_frame.start_address(), Entry::PRESENT | Entry::WRITABLE | Entry::NO_EXECUTE);
+
+        out << "Physmap: " << dec << windows << " x 2 MiB at " << hex << PHYSMAP_OFFSET << out.endl;
+    }
+
+    template<typename Allocator>
+    void remap_the_kernel(Allocator &allocator, BootInfo &boot_info) {
+        auto& out = vga::out();
+
+        auto& active_table = ActivePageTable::instance();
+        active_table.print(out, 1);
+        auto new_table_frame = allocator.allocate_frame().expect("Out of memory");
+        auto new_table = InactivePageTable(new_table_frame);
+
+        // Build the new table directly through the physmap
+        auto map = new_table.mapper();
+        // Map kernel ELF sections at BOTH identity (low) and higher-half (high) addresses
+        auto elf = boot_info.get_elf_sections().expect("Elf sections required");
+        uint64_t kernel_start = UINT64_MAX;
+        uint64_t kernel_end = 0;
+        for (auto section = elf->sections_begin(); section != elf->sections_end(); ++section) {
+            if (!section->is_allocated()) {
+                continue;
             }
+            ASSERT(section->addr % PAGE_SIZE == 0, "Elf sections must be page alined");
+            out << "mapping section " << elf->get_section_name(section) << " at addr: " << hex << section->addr << ", size: " << size << section->size << out.endl;
+            auto flags = PageFlags::from_elf_section(*section);
+
+            auto start_frame = memory::Frame::containing_address(section->addr);
+            auto end_frame = memory::Frame::containing_address(section->addr + section->size - 1);
+            auto frame_count = end_frame.number - start_frame.number + 1;
+            // Identity map (low address)
+            auto identity_mapped = map.identity_map_range(start_frame, frame_count, flags, allocator);
+            // Also map to higher-half (high address), where it stays in the TLB across switches
+            auto high_page = Page::containing_address(start_frame.start_address() + KERNEL_OFFSET);
+            auto high_flags = flags;
+            high_flags.global = true;
+            auto high_mapped = map.map_range_to(high_page, start_frame, frame_count, high_flags, allocator);
+            ASSERT(identity_mapped && high_mapped, "Out of memory mapping the kernel");
+
+            if (start_frame.start_address() < kernel_start) kernel_start = start_frame.start_address();
+            if (end_frame.start_address() + PAGE_SIZE > kernel_end) kernel_end = end_frame.start_address() + PAGE_SIZE;
+        }
 
-            // Map VGA text buffer at both low and high addresses
-            auto vga_buffer_frame = memory::Frame::containing_address(0xb8000);
-            map.identity_map(vga_buffer_frame, PageFlags {.writable = true}, allocator);
-            auto high_vga_page = Page::containing_address(0xb8000 + KERNEL_OFFSET);
-            map.map_to(high_vga_page, vga_buffer_frame, PageFlags {.writable = true}, allocator);
-        });
+        // Map multiboot information at both low and high addresses
+        auto multiboot_start = reinterpret_cast<uint64_t>(&boot_info);
+        auto multiboot_end   = multiboot_start + boot_info.get_total_size();
+        auto start_frame = memory::Frame::containing_address(multiboot_start);
+        auto end_frame = memory::Frame::containing_address(multiboot_end);
+        for (uint64_t i = start_frame.number; i <= end_frame.number; ++i) {
+            auto frame = memory::Frame(i);
+            if (map.translate(frame.start_address()).has_value()) {
+                // already mapped as part of kernel
+                continue;
+            }
+            // Identity map
+            map.identity_map(frame, PageFlags {}, allocator);
+            // Also map to higher-half
+            auto high_page = Page::containing_address(frame.start_address() + KERNEL_OFFSET);
+            auto high_mapped = map.map_to(high_page, frame, PageFlags {.global = true}, allocator);
+            ASSERT(high_mapped, "Out of memory mapping the boot information");
+        }
+
+        // Keep the VGA text buffer identity mapped, it moves to an ioremap() mapping once the
+        // kernel runs at high addresses
+        auto vga_buffer_frame = memory::Frame::containing_address(0xb8000);
+        map.identity_map(vga_buffer_frame, PageFlags {.writable = true, .write_combining = true}, allocator);
+
+        // Collapse the 2 MiB windows of the higher-half kernel image that ended up
+        // fully mapped with uniform flags into huge pages
+        auto high_kernel = Page::containing_address(kernel_start + KERNEL_OFFSET);
+        map.promote_range(high_kernel, (kernel_end - kernel_start) / PAGE_SIZE, allocator);
+
+        // carry the physmap over
+        (*new_table.p4())[PHYSMAP_P4_INDEX] = (*cr3::get_virt_p4_table())[PHYSMAP_P4_INDEX];
 
         // swap the active table and the new table
         active_table.swap(new_table);
 
-        // Update VGA buffer address
-        out.update_buffer_address((uint64_t)0xb8000 + KERNEL_OFFSET);
-
         out << "Kernel remapped with double mapping (low + high addresses)" << out.endl;
     }
 
+    // P4 table new address spaces are copied from, 0 until init_address_space_template() ran
+    static PhysicalAddress template_p4 = 0;
+
+    template<typename Allocator>
+    void init_address_space_template(Allocator& allocator) {
+        ASSERT(template_p4 == 0, "Address space template already built");
+        auto frame = allocator.allocate_zeroed_frame().expect("Out of memory");
+
+        // share the kernel half: the template points to the same P3 tables
+        auto p4 = phys_to_virt<P4Table>(frame.start_address());
+        auto active_p4 = cr3::get_virt_p4_table();
+        for (uint16_t i = KERNEL_HALF_P4_INDEX; i < P4Table::ENTRY_COUNT; i++) {
+            (*p4)[i] = (*active_p4)[i];
+        }
+        template_p4 = frame.start_address();
+    }
+
+    void share_with_user(VirtualAddress address) {
+        ASSERT(template_p4 != 0, "Address space template not built");
+        auto page = Page::containing_address(address);
+
+        // The P4 entry is copied into every address space, the tables below are shared.
+        // A huge page ends the walk, its entry carries the flag for the whole page.
+        auto p4 = phys_to_virt<P4Table>(template_p4);
+        (*p4)[page.p4_index()].set_user_accessible(true);
+        auto p3 = p4->get_next_table(page.p4_index());
+        if (p3) {
+            (*p3)[page.p3_index()].set_user_accessible(true);
+            auto p2 = p3->get_next_table(page.p3_index());
+            if (p2) {
+                (*p2)[page.p2_index()].set_user_accessible(true);
+                auto p1 = p2->get_next_table(page.p2_index());
+                if (p1) {
+                    (*p1)[page.p1_index()].set_user_accessible(true);
+                }
+            }
+        }
+
+        // kernel pages are global, drop the translation cached without the user flag
+        tlb::flush_page(address);
+    }
+
+    template<typename Allocator>
+    InactivePageTable create_address_space(Allocator& allocator) {
+        ASSERT(template_p4 != 0, "Address space template not built");
+        auto frame = allocator.allocate_frame().expect("Out of memory");
+        // every entry is overwritten by the copy below, so the frame need not be cleared
+        auto table = InactivePageTable(frame, true);
+        table.pcid = tlb::allocate_pcid();
+
+        // A single page copy, independent of how much the kernel half maps
+        memcpy(table.p4(), phys_to_virt<P4Table>(template_p4), PAGE_SIZE);
+        return table;
+    }
+
+    template<typename Allocator>
+    void destroy_address_space(InactivePageTable& table, Allocator& allocator) {
+        ASSERT(table.p4_frame.number != cr3::get_frame().number, "Cannot destroy the active address space");
+
+        table.mapper().unmap_user_half(allocator);
+        allocator.deallocate_frame(table.p4_frame);
+        // the TLB may still hold user half translations tagged with the PCID
+        tlb::release_pcid(table.pcid);
+    }
+
+    void switch_address_space(const InactivePageTable& table) {
+        tlb::switch_to(table.p4_frame.start_address(), table.pcid);
+    }
+
     void jump_to_higher_half(void (*continuation)()) {
         // Adjust the continuation function pointer to high address
         uint64_t continuation_addr = reinterpret_cast<uint64_t>(continuation);
@@ -107,15 +277,15 @@ namespace paging {
     }
 
     void unmap_lower_half() {
-        // Get the P4 table through recursive mapping
+        // Get the active P4 table through the physmap
         auto p4_table = cr3::get_virt_p4_table();
 
         // Clear P4[0] which contains the identity mapping
         // This unmaps the entire lower 512 GB (0x0 - 0x7FFFFFFFFF)
         p4_table->get_entries()[0].clear();
 
-        // Flush TLB to ensure the unmapping takes effect
-        cr3::flush();
+        // Flush TLB to ensure the unmapping takes effect (the identity mapping is not global)
+        tlb::flush_all();
 
         // Note: No VGA output here to avoid any potential issues with low memory access
     }
@@ -123,12 +293,23 @@ namespace paging {
 
     // PageFlags implementations
     uint64_t PageFlags::to_raw() const {
+        ASSERT(!(write_combining && (write_through || no_cache)), "Write-combining excludes other cache flags");
         uint64_t flags = Entry::PRESENT;  // Always present
         if (writable) flags |= Entry::WRITABLE;
         if (user_accessible) flags |= Entry::USER;
         if (write_through) flags |= Entry::WRITE_THROUGH;
         if (no_cache) flags |= Entry::NO_CACHE;
+        // without a PAT, write-combining falls back to uncacheable (PCD and PWT)
+        if (write_combining) flags |= pat::enabled ? Entry::PAT : Entry::NO_CACHE | Entry::WRITE_THROUGH;
         if (no_execute) flags |= Entry::NO_EXECUTE;
+        if (global && tlb::global_pages_enabled()) flags |= Entry::GLOBAL;
+        return flags;
+    }
+
+    uint64_t PageFlags::to_raw_huge() const {
+        // bit 7 selects the PAT entry for 4 KiB pages only, huge pages use bit 12
+        auto flags = to_raw() | Entry::HUGE;
+        if (write_combining && pat::enabled) flags |= Entry::PAT_HUGE;
         return flags;
     }
 
@@ -184,10 +365,12 @@ namespace paging {
     ActivePageTable ActivePageTable::instance_;
 
     ActivePageTable& ActivePageTable::instance() {
+        // follow address space switches
+        instance_.p4_table = cr3::get_virt_p4_table();
         return instance_;
     }
 
-    rnt::Optional<PhysicalAddress> ActivePageTable::translate(VirtualAddress vaddr) {
+    rnt::Optional<PhysicalAddress> Mapper::translate(VirtualAddress vaddr) {
         auto offset = vaddr % PAGE_SIZE;
         auto page = Page::containing_address(vaddr);
         auto frame = translate_page(page);
@@ -196,77 +379,571 @@ namespace paging {
         : frame.value().number * PAGE_SIZE + offset;
     }
 
+    // Flags of a huge page entry, including its PAT bit
+    static uint64_t huge_flags(uint64_t raw) {
+        return raw & ~0x000FFFFFFFFFE000ULL;
+    }
+
+    // Flags of a 2 MiB entry for the 4 KiB entries it is split into, and the other way round
+    static uint64_t huge_flags_to_small(uint64_t raw) {
+        auto flags = raw & ~0x000FFFFFFFFFF000ULL & ~static_cast<uint64_t>(Entry::HUGE);
+        if (raw & Entry::PAT_HUGE) flags |= Entry::PAT;
+        return flags;
+    }
+
+    static uint64_t small_flags_to_huge(uint64_t raw) {
+        auto flags = raw & ~0x000FFFFFFFFFF000ULL;
+        if (raw & Entry::PAT) flags |= Entry::PAT_HUGE;
+        return flags | Entry::HUGE;
+    }
+
+    // cached result of the CPUID query: 0 = not queried yet, 1 = unsupported, 2 = supported
+    static uint8_t huge_1g_support = 0;
+
+    bool Mapper::supports_1g_pages() {
+        if (huge_1g_support == 0) {
+            huge_1g_support = cpuid::has_1gb_pages() ? 2 : 1;
+        }
+        return huge_1g_support == 2;
+    }
+
+    // Count one more used entry in the table `counter` points to, nullptr if that table is not counted
+    static void count_entry(Entry* counter) {
+        if (counter != nullptr) {
+            ASSERT(counter->used_entries() < P1Table::ENTRY_COUNT, "Page table use count out of sync");
+            counter->set_used_entries(counter->used_entries() + 1);
+        }
+    }
+
+    // next_table_create() that counts a newly created table in the entry pointing to `table`
+    template<int Level, typename Allocator>
+    static Table<Level - 1>* table_create(Table<Level>* table, uint16_t index, Entry* counter, Allocator& allocator) {
+        bool created = !(*table)[index].is_present();
+        auto* next = table->next_table_create(index, allocator);
+        if (created && next != nullptr) {
+            count_entry(counter);
+        }
+        return next;
+    }
+
     template<typename Allocator>
-    void ActivePageTable::map_to(Page page, memory::Frame frame, PageFlags flags, Allocator &allocator) {
+    Mapper::Walk Mapper::walk_create(Page page, Allocator &allocator) {
         // Walk down the page table hierarchy, creating tables as needed
-        auto* p3 = p4_table->next_table_create(page.p4_index(), allocator);
-        ASSERT(p3 != nullptr, "Out of memory allocating P3 table");
+        Walk walk{};
+        walk.p4_entry = page.p4_index() < KERNEL_HALF_P4_INDEX ? &(*p4_table)[page.p4_index()] : nullptr;
+        // Tables created before an allocation fails stay in place, they are empty and
+        // counted correctly, so the next mapping in their range simply reuses them.
+        walk.p3 = p4_table->next_table_create(page.p4_index(), allocator);
+        if (walk.p3 == nullptr) {
+            return walk;
+        }
+        walk.p3_entry = &(*walk.p3)[page.p3_index()];
+        if (walk.p3_entry->is_huge() && !split_huge_p3(walk.p3, page.p3_index(), page, allocator)) {
+            return walk;
+        }
+
+        walk.p2 = table_create(walk.p3, page.p3_index(), walk.p4_entry, allocator);
+        if (walk.p2 == nullptr) {
+            return walk;
+        }
+        walk.p2_entry = &(*walk.p2)[page.p2_index()];
+        if (walk.p2_entry->is_huge() && !split_huge_p2(walk.p2, page.p2_index(), page, allocator)) {
+            return walk;
+        }
+
+        walk.p1 = table_create(walk.p2, page.p2_index(), walk.p3_entry, allocator);
+        return walk;
+    }
+
+    template<typename Allocator>
+    bool Mapper::release_entry(Page page, uint8_t level, Allocator &allocator) {
+        // counters[l] is the entry that counts the used entries of the level l table
+        Entry* counters[4] = {nullptr, nullptr, nullptr, nullptr};
+        counters[3] = page.p4_index() < KERNEL_HALF_P4_INDEX ? &(*p4_table)[page.p4_index()] : nullptr;
+        auto* p3 = p4_table->get_next_table(page.p4_index());
+        if (level <= 2) {
+            counters[2] = &(*p3)[page.p3_index()];
+        }
+        if (level == 1) {
+            counters[1] = &(*p3->get_next_table(page.p3_index()))[page.p2_index()];
+        }
+
+        for (uint8_t l = level; l <= 3; l++) {
+            auto* counter = counters[l];
+            if (counter == nullptr) {
+                return l > level;
+            }
+            auto used = counter->used_entries();
+            ASSERT(used > 0, "Page table use count out of sync");
+            counter->set_used_entries(used - 1);
+            if (used > 1) {
+                return l > level;
+            }
 
-        P2Table* p2 = p3->next_table_create(page.p3_index(), allocator);
-        ASSERT(p2 != nullptr, "Out of memory allocating P2 table");
+            // The table is empty, free it and clear its entry in the level above. The
+            // caller invalidates the page, which also drops cached paging structures.
+            auto table = counter->get_frame().value();
+            counter->clear();
+            allocator.deallocate_frame(table);
+            if (page.p4_index() >= KERNEL_HALF_P4_INDEX) {
+                // other address spaces share the table and may have it cached under their PCID
+                tlb::flush_everything();
+            }
+        }
+        return true;
+    }
+
+    P1Table* Mapper::p1_table(Page page) {
+        auto* p3 = p4_table->get_next_table(page.p4_index());
+        if (!p3) {
+            return nullptr;
+        }
+        P2Table* p2 = p3->get_next_table(page.p3_index());
+        if (!p2) {
+            return nullptr;
+        }
+        return p2->get_next_table(page.p2_index());
+    }
+
+    template<typename Allocator>
+    bool Mapper::split_huge_p3(P3Table* p3, uint16_t index, Page page, Allocator &allocator) {
+        Entry& entry = (*p3)[index];
+        auto base = entry.get_huge_address();
+        auto flags = huge_flags(entry.get_raw());
+
+        auto frame = allocator.allocate_frame();
+        if (frame.is_empty()) {
+            return false;
+        }
+        entry.set(frame.value().start_address(), Entry::PRESENT | Entry::WRITABLE | Entry::USER);
+        entry.set_used_entries(P2Table::ENTRY_COUNT);
 
-        P1Table* p1 = p2->next_table_create(page.p2_index(), allocator);
-        ASSERT(p1 != nullptr, "Out of memory allocating P1 table");
+        // every 2 MiB entry of the new P2 table inherits the flags of the 1 GiB page
+        auto* p2 = p3->get_next_table(index);
+        for (uint16_t i = 0; i < P2Table::ENTRY_COUNT; i++) {
+            (*p2)[i].set_raw((base + i * HUGE_2M_PAGES * PAGE_SIZE) | flags);
+        }
+
+        auto first = Page(page.number & ~(HUGE_1G_PAGES - 1));
+        tlb::flush_range(first.start_addr(), HUGE_1G_PAGES);
+        return true;
+    }
+
+    template<typename Allocator>
+    bool Mapper::split_huge_p2(P2Table* p2, uint16_t index, Page page, Allocator &allocator) {
+        Entry& entry = (*p2)[index];
+        auto base = entry.get_huge_address();
+        auto flags = huge_flags_to_small(entry.get_raw());
+
+        auto frame = allocator.allocate_frame();
+        if (frame.is_empty()) {
+            return false;
+        }
+        entry.set(frame.value().start_address(), Entry::PRESENT | Entry::WRITABLE | Entry::USER);
+        entry.set_used_entries(P1Table::ENTRY_COUNT);
+
+        // every 4 KiB entry of the new P1 table inherits the flags of the 2 MiB page
+        auto* p1 = p2->get_next_table(index);
+        for (uint16_t i = 0; i < P1Table::ENTRY_COUNT; i++) {
+            (*p1)[i].set(base + i * PAGE_SIZE, flags);
+        }
+
+        auto first = Page(page.number & ~(HUGE_2M_PAGES - 1));
+        tlb::flush_range(first.start_addr(), HUGE_2M_PAGES);
+        return true;
+    }
+
+    template<typename Allocator>
+    bool Mapper::map_to(Page page, memory::Frame frame, PageFlags flags, Allocator &allocator) {
+        auto walk = walk_create(page, allocator);
+        if (walk.p1 == nullptr) {
+            return false;
+        }
 
         // Verify the entry is unused
-        Entry& entry = (*p1)[page.p1_index()];
+        Entry& entry = (*walk.p1)[page.p1_index()];
         ASSERT(entry.is_unused(), "Page already mapped");
 
         // Set the entry to map to the frame with converted flags
         entry.set(frame.start_address(), flags.to_raw());
+        count_entry(walk.p2_entry);
+        return true;
     }
 
     template<typename Allocator>
-    void ActivePageTable::map(Page page, PageFlags flags, Allocator &allocator) {
+    void Mapper::map(Page page, PageFlags flags, Allocator &allocator) {
         auto frame = allocator.allocate_frame();
         ASSERT(frame.has_value(), "out of memory");
-        map_to(page, frame.value(), flags, allocator);
+        auto mapped = map_to(page, frame.value(), flags, allocator);
+        ASSERT(mapped, "Out of memory allocating page table");
     }
 
     template<typename Allocator>
-    void ActivePageTable::identity_map(memory::Frame frame, PageFlags flags, Allocator &allocator) {
+    void Mapper::identity_map(memory::Frame frame, PageFlags flags, Allocator &allocator) {
         auto page = Page::containing_address(frame.start_address());
-        map_to(page, frame, flags, allocator);
+        auto mapped = map_to(page, frame, flags, allocator);
+        ASSERT(mapped, "Out of memory allocating page table");
     }
 
     template<typename Allocator>
-    void ActivePageTable::unmap(Page page, Allocator &allocator) {
+    void Mapper::unmap(Page page, Allocator &allocator) {
         ASSERT(translate(page.start_addr()).has_value(), "Page not mapped");
 
-        auto* p3 = p4_table->get_next_table(page.p4_index());
-        ASSERT(p3 != nullptr, "Huge pages not supported by mapping code");
-        P2Table* p2 = p3->get_next_table(page.p3_index());
-        ASSERT(p2 != nullptr, "Huge pages not supported by mapping code");
-        P1Table* p1 = p2->get_next_table(page.p2_index());
+        // a single page inside a huge page: split it up first
+        auto walk = walk_create(page, allocator);
+        ASSERT(walk.p1 != nullptr, "Out of memory splitting huge page");
 
-        auto &entry = p1->get_entries()[page.p1_index()];
+        auto &entry = (*walk.p1)[page.p1_index()];
         auto frame = entry.get_frame().value();
         entry.clear();
         allocator.deallocate_frame(frame);
-        // flush the lookaside buffer (TLB)
-        cr3::flush();
+        release_entry(page, 1, allocator);
+        // flush the lookaside buffer (TLB) for this page only
+        tlb::flush_page(page.start_addr());
+    }
+
+    template<typename Allocator>
+    bool Mapper::map_huge_2m(Page page, memory::Frame frame, PageFlags flags, Allocator &allocator) {
+        ASSERT(page.number % HUGE_2M_PAGES == 0 && frame.number % HUGE_2M_PAGES == 0, "Huge page not 2 MiB aligned");
+
+        auto* p4_entry = page.p4_index() < KERNEL_HALF_P4_INDEX ? &(*p4_table)[page.p4_index()] : nullptr;
+        auto* p3 = p4_table->next_table_create(page.p4_index(), allocator);
+        if (p3 == nullptr) {
+            return false;
+        }
+        if ((*p3)[page.p3_index()].is_huge() && !split_huge_p3(p3, page.p3_index(), page, allocator)) {
+            return false;
+        }
+        P2Table* p2 = table_create(p3, page.p3_index(), p4_entry, allocator);
+        if (p2 == nullptr) {
+            return false;
+        }
+
+        Entry& entry = (*p2)[page.p2_index()];
+        ASSERT(entry.is_unused(), "Page already mapped");
+        entry.set_raw(frame.start_address() | flags.to_raw_huge());
+        count_entry(&(*p3)[page.p3_index()]);
+        return true;
+    }
+
+    template<typename Allocator>
+    bool Mapper::map_huge_1g(Page page, memory::Frame frame, PageFlags flags, Allocator &allocator) {
+        ASSERT(supports_1g_pages(), "CPU does not support 1 GiB pages");
+        ASSERT(page.number % HUGE_1G_PAGES == 0 && frame.number % HUGE_1G_PAGES == 0, "Huge page not 1 GiB aligned");
+
+        auto* p3 = p4_table->next_table_create(page.p4_index(), allocator);
+        if (p3 == nullptr) {
+            return false;
+        }
+
+        Entry& entry = (*p3)[page.p3_index()];
+        ASSERT(entry.is_unused(), "Page already mapped");
+        entry.set_raw(frame.start_address() | flags.to_raw_huge());
+        count_entry(page.p4_index() < KERNEL_HALF_P4_INDEX ? &(*p4_table)[page.p4_index()] : nullptr);
+        return true;
+    }
+
+    template<typename Allocator>
+    bool Mapper::map_range_to(Page start, memory::Frame frame, uint64_t count, PageFlags flags, Allocator &allocator) {
+        auto raw_flags = flags.to_raw();
+        Walk walk{};
+        uint64_t i = 0;
+        while (i < count) {
+            auto page = Page(start.number + i);
+            auto target = memory::Frame(frame.number + i);
+            auto remaining = count - i;
+
+            // use the largest page size for which page and frame are aligned and that still fits
+            if (remaining >= HUGE_1G_PAGES && page.number % HUGE_1G_PAGES == 0
+                && target.number % HUGE_1G_PAGES == 0 && supports_1g_pages()) {
+                if (!map_huge_1g(page, target, flags, allocator)) {
+                    break;
+                }
+                i += HUGE_1G_PAGES;
+                walk.p1 = nullptr;
+                continue;
+            }
+            if (remaining >= HUGE_2M_PAGES && page.number % HUGE_2M_PAGES == 0 && target.number % HUGE_2M_PAGES == 0) {
+                if (!map_huge_2m(page, target, flags, allocator)) {
+                    break;
+                }
+                i += HUGE_2M_PAGES;
+                walk.p1 = nullptr;
+                continue;
+            }
+
+            // only walk the hierarchy again when we cross into the next P1 table
+            if (walk.p1 == nullptr || page.p1_index() == 0) {
+                walk = walk_create(page, allocator);
+                if (walk.p1 == nullptr) {
+                    break;
+                }
+            }
+
+            Entry& entry = (*walk.p1)[page.p1_index()];
+            ASSERT(entry.is_unused(), "Page already mapped");
+            entry.set(target.start_address(), raw_flags);
+            count_entry(walk.p2_entry);
+            i++;
+        }
+        if (i < count) {
+            // out of memory for a page table, take back what was mapped so far
+            if (i > 0) {
+                unmap_range(start, i, allocator, false);
+            }
+            return false;
+        }
+        // the pages were not present before, so there are no stale TLB entries to invalidate
+        return true;
+    }
+
+    template<typename Allocator>
+    bool Mapper::map_range(Page start, uint64_t count, PageFlags flags, Allocator &allocator) {
+        // Frames are pulled as contiguous runs of up to one P1 table worth of frames.
+        // Runs that cover a whole aligned 2 MiB window are requested 2 MiB aligned, so
+        // that map_range_to can use a huge page for them. If physical memory is too
+        // fragmented for a run, the batch size is halved.
+        uint64_t mapped = 0;
+        while (mapped < count) {
+            auto page = Page(start.number + mapped);
+            uint64_t to_boundary = HUGE_2M_PAGES - page.p1_index();
+            uint64_t batch = count - mapped < to_boundary ? count - mapped : to_boundary;
+
+            auto align = batch == HUGE_2M_PAGES ? HUGE_2M_PAGES * PAGE_SIZE : PAGE_SIZE;
+            auto run = allocator.allocate_frames(batch, align);
+            while (run.is_empty() && batch > 1) {
+                batch /= 2;
+                run = allocator.allocate_frames(batch);
+            }
+            if (run.is_empty() || !map_range_to(page, run.value(), batch, flags, allocator)) {
+                // out of memory, free the run and everything mapped before it
+                if (run.has_value()) {
+                    allocator.deallocate_frames(run.value(), batch);
+                }
+                if (mapped > 0) {
+                    unmap_range(start, mapped, allocator);
+                }
+                return false;
+            }
+            mapped += batch;
+        }
+        return true;
+    }
+
+    template<typename Allocator>
+    bool Mapper::identity_map_range(memory::Frame start, uint64_t count, PageFlags flags, Allocator &allocator) {
+        return map_range_to(Page::containing_address(start.start_address()), start, count, flags, allocator);
+    }
+
+    template<typename Allocator>
+    void Mapper::unmap_range(Page start, uint64_t count, Allocator &allocator, bool free_frames) {
+        Walk walk{};
+        uint64_t i = 0;
+        while (i < count) {
+            auto page = Page(start.number + i);
+            auto remaining = count - i;
+
+            // huge pages that are covered completely are dropped as a whole
+            auto* p3 = p4_table->get_next_table(page.p4_index());
+            ASSERT(p3 != nullptr, "Page not mapped");
+            Entry& p3_entry = (*p3)[page.p3_index()];
+            if (p3_entry.is_huge() && page.number % HUGE_1G_PAGES == 0 && remaining >= HUGE_1G_PAGES) {
+                if (free_frames) {
+                    allocator.deallocate_frames(memory::Frame::containing_address(p3_entry.get_huge_address()), HUGE_1G_PAGES);
+                }
+                p3_entry.clear();
+                release_entry(page, 3, allocator);
+                i += HUGE_1G_PAGES;
+                walk.p1 = nullptr;
+                continue;
+            }
+            if (!p3_entry.is_huge()) {
+                auto* p2 = p3->get_next_table(page.p3_index());
+                ASSERT(p2 != nullptr, "Page not mapped");
+                Entry& p2_entry = (*p2)[page.p2_index()];
+                if (p2_entry.is_huge() && page.number % HUGE_2M_PAGES == 0 && remaining >= HUGE_2M_PAGES) {
+                    if (free_frames) {
+                        allocator.deallocate_frames(memory::Frame::containing_address(p2_entry.get_huge_address()), HUGE_2M_PAGES);
+                    }
+                    p2_entry.clear();
+                    release_entry(page, 2, allocator);
+                    i += HUGE_2M_PAGES;
+                    walk.p1 = nullptr;
+                    continue;
+                }
+            }
+
+            // only walk the hierarchy again when we cross into the next P1 table,
+            // splitting a partially unmapped huge page on the way
+            if (walk.p1 == nullptr || page.p1_index() == 0) {
+                walk = walk_create(page, allocator);
+                ASSERT(walk.p1 != nullptr, "Out of memory splitting huge page");
+            }
+
+            auto &entry = (*walk.p1)[page.p1_index()];
+            auto frame = entry.get_frame();
+            ASSERT(frame.has_value(), "Page not mapped");
+            entry.clear();
+            // Nothing runs between here and the flush below that could hand out the
+            // frame or a freed table again, so they can be returned before the TLB is invalidated.
+            if (free_frames) {
+                allocator.deallocate_frame(frame.value());
+            }
+            if (release_entry(page, 1, allocator)) {
+                walk.p1 = nullptr;
+            }
+            i++;
+        }
+        tlb::flush_range(start.start_addr(), count);
+    }
+
+    template<typename Allocator>
+    void Mapper::unmap_user_half(Allocator &allocator) {
+        for (uint16_t i4 = 0; i4 < KERNEL_HALF_P4_INDEX; i4++) {
+            auto* p3 = p4_table->get_next_table(i4);
+            if (p3 == nullptr) {
+                continue;
+            }
+            for (uint16_t i3 = 0; i3 < P3Table::ENTRY_COUNT; i3++) {
+                Entry& p3_entry = (*p3)[i3];
+                if (p3_entry.is_present() && p3_entry.is_huge()) {
+                    allocator.deallocate_frames(memory::Frame::containing_address(p3_entry.get_huge_address()), HUGE_1G_PAGES);
+                    continue;
+                }
+                auto* p2 = p3->get_next_table(i3);
+                if (p2 == nullptr) {
+                    continue;
+                }
+                for (uint16_t i2 = 0; i2 < P2Table::ENTRY_COUNT; i2++) {
+                    Entry& p2_entry = (*p2)[i2];
+                    if (p2_entry.is_present() && p2_entry.is_huge()) {
+                        allocator.deallocate_frames(memory::Frame::containing_address(p2_entry.get_huge_address()), HUGE_2M_PAGES);
+                        continue;
+                    }
+                    auto* p1 = p2->get_next_table(i2);
+                    if (p1 == nullptr) {
+                        continue;
+                    }
+                    for (uint16_t i1 = 0; i1 < P1Table::ENTRY_COUNT; i1++) {
+                        auto frame = (*p1)[i1].get_frame();
+                        if (frame.has_value()) {
+                            allocator.deallocate_frame(frame.value());
+                        }
+                    }
+                    allocator.deallocate_frame(p2_entry.get_frame().value());
+                }
+                allocator.deallocate_frame(p3_entry.get_frame().value());
+            }
+            allocator.deallocate_frame((*p4_table)[i4].get_frame().value());
+            (*p4_table)[i4].clear();
+        }
+        // the table is not active, so no stale translations can exist
+    }
+
+    /**
+     * Whether the entries of a table map physically contiguous memory with uniform flags,
+     * so that they can be replaced by one huge entry covering `entry_pages` pages each.
+     */
+    template<int Level>
+    static bool is_promotable(const Table<Level>& table, uint64_t entry_pages, bool entries_huge) {
+        constexpr uint64_t IGNORED = Entry::ACCESSED | Entry::DIRTY;
+        auto address = [entries_huge](const Entry& entry) {
+            return entries_huge ? entry.get_huge_address() : entry.get_address();
+        };
+        auto flags = [entries_huge](const Entry& entry) {
+            auto raw = entry.get_raw();
+            return (entries_huge ? huge_flags(raw) : raw & ~0x000FFFFFFFFFF000ULL) & ~IGNORED;
+        };
+
+        const Entry& first = table[0];
+        if (!first.is_present() || first.is_huge() != entries_huge) {
+            return false;
+        }
+        if ((address(first) / PAGE_SIZE) % (entry_pages * Table<Level>::ENTRY_COUNT) != 0) {
+            return false;
+        }
+        for (uint16_t i = 1; i < Table<Level>::ENTRY_COUNT; i++) {
+            const Entry& entry = table[i];
+            if (!entry.is_present()
+                || address(entry) != address(first) + i * entry_pages * PAGE_SIZE
+                || flags(entry) != flags(first)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<typename Allocator>
+    void Mapper::promote_range(Page start, uint64_t count, Allocator &allocator) {
+        auto end = start.number + count;
+
+        // 4 KiB -> 2 MiB for every aligned 2 MiB window inside the range
+        auto first_2m = (start.number + HUGE_2M_PAGES - 1) & ~(HUGE_2M_PAGES - 1);
+        for (auto number = first_2m; number + HUGE_2M_PAGES <= end; number += HUGE_2M_PAGES) {
+            auto page = Page(number);
+            P1Table* p1 = p1_table(page);
+            if (p1 == nullptr || !is_promotable(*p1, 1, false)) {
+                continue;
+            }
+            auto* p2 = p4_table->get_next_table(page.p4_index())->get_next_table(page.p3_index());
+            Entry& entry = (*p2)[page.p2_index()];
+            auto table_frame = entry.get_frame().value();
+            const Entry& first = (*p1)[0];
+            entry.set_raw(first.get_address() | small_flags_to_huge(first.get_raw()));
+            tlb::flush_range(page.start_addr(), HUGE_2M_PAGES);
+            allocator.deallocate_frame(table_frame);
+        }
+
+        if (!supports_1g_pages()) {
+            return;
+        }
+
+        // 2 MiB -> 1 GiB for every aligned 1 GiB window inside the range
+        auto first_1g = (start.number + HUGE_1G_PAGES - 1) & ~(HUGE_1G_PAGES - 1);
+        for (auto number = first_1g; number + HUGE_1G_PAGES <= end; number += HUGE_1G_PAGES) {
+            auto page = Page(number);
+            auto* p3 = p4_table->get_next_table(page.p4_index());
+            if (p3 == nullptr) {
+                continue;
+            }
+            P2Table* p2 = p3->get_next_table(page.p3_index());
+            if (p2 == nullptr || !is_promotable(*p2, HUGE_2M_PAGES, true)) {
+                continue;
+            }
+            Entry& entry = (*p3)[page.p3_index()];
+            auto table_frame = entry.get_frame().value();
+            const Entry& first = (*p2)[0];
+            entry.set_raw(first.get_huge_address() | huge_flags(first.get_raw()));
+            tlb::flush_range(page.start_addr(), HUGE_1G_PAGES);
+            allocator.deallocate_frame(table_frame);
+        }
     }
 
     void ActivePageTable::swap(InactivePageTable& inactive_page_table) {
         auto p4_frame = cr3::get_frame();
         auto new_p4_frame = inactive_page_table.p4_frame;
         inactive_page_table.p4_frame = p4_frame;
+        // loading CR3 flushes the TLB
         cr3::set_phys_addr(new_p4_frame.start_address());
-        cr3::flush();
+        p4_table = phys_to_virt<P4Table>(new_p4_frame.start_address());
     }
 
 
 
-    rnt::Optional<memory::Frame> ActivePageTable::translate_page(Page page) {
+    rnt::Optional<memory::Frame> Mapper::translate_page(Page page) {
         // Walk through the page table hierarchy
-        P4Table* p4 = cr3::get_virt_p4_table();
-
-        // Get P3 table
-        P3Table* p3 = p4->get_next_table(page.p4_index());
+        P3Table* p3 = p4_table->get_next_table(page.p4_index());
         if (!p3) {
             return rnt::Optional<memory::Frame>();
         }
 
+        // Check if this is a huge page (1GB)
+        const Entry& p3_entry = (*p3)[page.p3_index()];
+        if (p3_entry.is_present() && p3_entry.is_huge()) {
+            uint64_t huge_frame_base = p3_entry.get_huge_address() / PAGE_SIZE;
+            return memory::Frame(huge_frame_base + page.p2_index() * HUGE_2M_PAGES + page.p1_index());
+        }
+
         // Get P2 table
         P2Table* p2 = p3->get_next_table(page.p3_index());
         if (!p2) {
@@ -275,10 +952,10 @@ namespace paging {
 
         // Check if this is a huge page (2MB)
         const Entry& p2_entry = (*p2)[page.p2_index()];
-        if (p2_entry.is_huge()) {
+        if (p2_entry.is_present() && p2_entry.is_huge()) {
             // For huge pages, the P2 entry contains the frame address
             // Frame number = (physical address / PAGE_SIZE) + P1 index offset
-            uint64_t huge_frame_base = p2_entry.get_address() / PAGE_SIZE;
+            uint64_t huge_frame_base = p2_entry.get_huge_address() / PAGE_SIZE;
             return memory::Frame(huge_frame_base + page.p1_index());
         }
 
@@ -293,92 +970,21 @@ namespace paging {
         return p1_entry.get_frame();
     }
 
-    template<typename F>
-    void ActivePageTable::with(InactivePageTable& table, TemporaryPage& temporary_page, F&& f) {
-        auto backup = memory::Frame::containing_address(cr3::get_phys_addr());
-        // map the temporary page on the current physical address of the active page table
-        auto temp_p4 = temporary_page.map_table_frame(backup, *this);
-
-        // point the recursive index to the inactive page table
-        p4_table->get_entries()[RECURSIVE_INDEX].set(table.p4_frame.start_address(), Entry::PRESENT | Entry::WRITABLE);
-        cr3::flush();
-
-        // execute lambda in this context
-        f(*this);
-
-        // restore the recursive index to the old state
-        temp_p4->get_entries()[RECURSIVE_INDEX].set(backup.start_address(), Entry::PRESENT | Entry::WRITABLE);
-        cr3::flush();
-
-        // unmap the temporary page mapping we created for backup table access
-        temporary_page.unmap(*this);
-    }
-
-
-    /**
-     * The tiny allocator has control over exaclty 3 frames that can be used
-     * by the TemporaryPage.
-     */
-    template<typename Allocator>
-    TinyAllocator::TinyAllocator(Allocator& allocator) {
-        for (int i = 0; i < 3; i++) {
-            frames[i] = allocator.allocate_frame().expect("Out of memory");
-            available[i] = true;
-        }
-    }
-
-    rnt::Optional<memory::Frame> TinyAllocator::allocate_frame() {
-        for (int i = 0; i < 3; i++) {
-            if (available[i]) {
-                available[i] = false;
-                return frames[i];
-            }
-        }
-        return rnt::Optional<memory::Frame>();
-    }
-
-    void TinyAllocator::deallocate_frame(memory::Frame frame) {
-        // we take back only the frames we own
-        for (int i = 0; i < 3; i++) {
-            if (frames[i].number == frame.number) {
-                ASSERT(!available[i], "Frame was already deallocated");
-                available[i] = true;
-                return;
-            }
-        }
-    }
-
-
-    template<typename Allocator>
-    TemporaryPage::TemporaryPage(Page page, Allocator& allocator): page(page), allocator(TinyAllocator(allocator)) {
-    }
-
-    VirtualAddress TemporaryPage::map(memory::Frame frame, ActivePageTable &active_table) {
-        ASSERT(active_table.translate_page(page).is_empty(), "Temporary page is already mapped");
-        active_table.map_to(page, frame, PageFlags{.writable = true}, allocator);
-        return page.start_addr();
-    }
-
-    void TemporaryPage::unmap(ActivePageTable &active_table) {
-        active_table.unmap(page, allocator);
-    }
-
-    P1Table* TemporaryPage::map_table_frame(memory::Frame frame, ActivePageTable &active_page_table) {
-        return reinterpret_cast<P1Table*>(map(frame, active_page_table));
-    }
-
     // Explicit template instantiations for concrete allocator types
     template void remap_the_kernel<memory::AreaFrameAllocator>(memory::AreaFrameAllocator&, BootInfo&);
-    template void ActivePageTable::map_to<memory::AreaFrameAllocator>(Page, memory::Frame, PageFlags, memory::AreaFrameAllocator&);
-    template void ActivePageTable::map<memory::AreaFrameAllocator>(Page, PageFlags, memory::AreaFrameAllocator&);
-    template void ActivePageTable::identity_map<memory::AreaFrameAllocator>(memory::Frame, PageFlags, memory::AreaFrameAllocator&);
-    template void ActivePageTable::unmap<memory::AreaFrameAllocator>(Page, memory::AreaFrameAllocator&);
-    template TinyAllocator::TinyAllocator(memory::AreaFrameAllocator&);
-    template TemporaryPage::TemporaryPage(Page, memory::AreaFrameAllocator&);
-
-    template void ActivePageTable::map_to<TinyAllocator>(Page, memory::Frame, PageFlags, TinyAllocator&);
-    template void ActivePageTable::map<TinyAllocator>(Page, PageFlags, TinyAllocator&);
-    template void ActivePageTable::identity_map<TinyAllocator>(memory::Frame, PageFlags, TinyAllocator&);
-    template void ActivePageTable::unmap<TinyAllocator>(Page, TinyAllocator&);
-
+    template bool Mapper::map_to<memory::AreaFrameAllocator>(Page, memory::Frame, PageFlags, memory::AreaFrameAllocator&);
+    template void Mapper::map<memory::AreaFrameAllocator>(Page, PageFlags, memory::AreaFrameAllocator&);
+    template void Mapper::identity_map<memory::AreaFrameAllocator>(memory::Frame, PageFlags, memory::AreaFrameAllocator&);
+    template void Mapper::unmap<memory::AreaFrameAllocator>(Page, memory::AreaFrameAllocator&);
+    template bool Mapper::map_range_to<memory::AreaFrameAllocator>(Page, memory::Frame, uint64_t, PageFlags, memory::AreaFrameAllocator&);
+    template bool Mapper::map_range<memory::AreaFrameAllocator>(Page, uint64_t, PageFlags, memory::AreaFrameAllocator&);
+    template bool Mapper::identity_map_range<memory::AreaFrameAllocator>(memory::Frame, uint64_t, PageFlags, memory::AreaFrameAllocator&);
+    template void Mapper::unmap_range<memory::AreaFrameAllocator>(Page, uint64_t, memory::AreaFrameAllocator&, bool);
+    template bool Mapper::map_huge_2m<memory::AreaFrameAllocator>(Page, memory::Frame, PageFlags, memory::AreaFrameAllocator&);
+    template bool Mapper::map_huge_1g<memory::AreaFrameAllocator>(Page, memory::Frame, PageFlags, memory::AreaFrameAllocator&);
+    template void Mapper::promote_range<memory::AreaFrameAllocator>(Page, uint64_t, memory::AreaFrameAllocator&);
+    template void init_address_space_template<memory::AreaFrameAllocator>(memory::AreaFrameAllocator&);
+    template InactivePageTable create_address_space<memory::AreaFrameAllocator>(memory::AreaFrameAllocator&);
+    template void destroy_address_space<memory::AreaFrameAllocator>(InactivePageTable&, memory::AreaFrameAllocator&);
+    template void init_physmap<memory::AreaFrameAllocator>(memory::AreaFrameAllocator&, BootInfo&);
 }
@@ -8,6 +8,7 @@
 
 #include "Entry.h"
 #include "Table.h"
+#include "tlb.h"
 #include "vga.hpp"
 #include "memory/frame.h"
 #include "memory/frame_allocator.h"
@@ -20,7 +21,6 @@ using VirtualAddress = uint64_t;
 namespace paging {
     // forward declarations
     class InactivePageTable;
-    class TemporaryPage;
 
     // Import PAGE_SIZE from memory namespace
     using memory::PAGE_SIZE;
@@ -30,9 +30,61 @@ namespace paging {
     constexpr uint64_t KERNEL_OFFSET = 0xFFFF800000000000ULL;
     constexpr uint16_t KERNEL_P4_INDEX = 510;
 
+    // P4 entries from this index up form the kernel half that is shared by all address spaces
+    constexpr uint16_t KERNEL_HALF_P4_INDEX = 256;
+
+    // Limit of the identity mapping the bootloader sets up with 2 MiB pages
+    constexpr PhysicalAddress BOOT_IDENTITY_LIMIT = 1024ULL * 1024 * 1024;
+
+    // Number of 4 KiB pages covered by a huge page in the P2 (2 MiB) and P3 (1 GiB) table
+    constexpr uint64_t HUGE_2M_PAGES = 512;
+    constexpr uint64_t HUGE_1G_PAGES = 512 * 512;
+
+    /**
+     * Map all usable RAM at PHYSMAP_OFFSET into the boot page table.
+     * Must run first, while the boot identity mapping is still active. The physmap
+     * is carried over into every table built afterwards.
+     */
+    template<typename Allocator>
+    void init_physmap(Allocator& allocator, BootInfo& boot_info);
+
     template<typename Allocator>
     void remap_the_kernel(Allocator& allocator, BootInfo& boot_info);
 
+    /**
+     * Build the P4 table every address space is created from: the kernel half P4 entries
+     * of the active table and an empty user half. Call once the kernel table is final,
+     * kernel half P4 entries created afterwards are missing from it.
+     */
+    template<typename Allocator>
+    void init_address_space_template(Allocator& allocator);
+
+    /**
+     * Make the kernel page at `address` accessible from ring 3 in every address space
+     * created afterwards. Sets the user flag on the way down in the template and in the
+     * kernel half tables it shares with all address spaces.
+     */
+    void share_with_user(VirtualAddress address);
+
+    /**
+     * Create a new address space as a copy of the template P4 table. The kernel half
+     * points to the same P3 tables as every other address space, the user half is empty.
+     */
+    template<typename Allocator>
+    InactivePageTable create_address_space(Allocator& allocator);
+
+    /**
+     * Free all user half mappings, page tables and the P4 table of an address space.
+     * The address space must not be active.
+     */
+    template<typename Allocator>
+    void destroy_address_space(InactivePageTable& table, Allocator& allocator);
+
+    /**
+     * Make the given address space the active one, without handing out the previous one
+     */
+    void switch_address_space(const InactivePageTable& table);
+
     /**
      * Jump to higher-half kernel and execute continuation function
      * This function does not return! It adjusts RSP to high address and calls the continuation.
@@ -55,10 +107,16 @@ namespace paging {
         bool user_accessible = false;
         bool write_through = false;
         bool no_cache = false;
+        // write-combining through PAT entry 4, for framebuffers and other MMIO
+        bool write_combining = false;
         bool no_execute = false;
+        // kept in the TLB across address space switches, only for kernel half mappings
+        bool global = false;
 
         // Convert to raw flags for Entry
         uint64_t to_raw() const;
+        // Convert to raw flags for a huge page entry in the P2 or P3 table
+        uint64_t to_raw_huge() const;
 
         // Static factory methods for common configurations
         static PageFlags kernel_readonly();
@@ -106,16 +164,22 @@ namespace paging {
         }
     };
 
-    class ActivePageTable {
+    /**
+     * Maps pages in the P4 table it is given. Page tables are reached through the
+     * physmap, so the table does not need to be active.
+     */
+    class Mapper {
+    protected:
         P4Table *p4_table;
+
     public:
-        static ActivePageTable& instance();
+        explicit Mapper(P4Table* p4_table): p4_table(p4_table) {}
 
         rnt::Optional<PhysicalAddress> translate(VirtualAddress vaddr);
 
-        // Map a page to a specific frame with given flags
+        // Map a page to a specific frame with given flags, false if a page table cannot be allocated
         template<typename Allocator>
-        void map_to(Page page, memory::Frame frame, PageFlags flags, Allocator& allocator);
+        bool map_to(Page page, memory::Frame frame, PageFlags flags, Allocator& allocator);
 
         // Map a page (allocates a frame automatically)
         template<typename Allocator>
@@ -125,72 +189,134 @@ namespace paging {
         template<typename Allocator>
         void identity_map(memory::Frame frame, PageFlags flags, Allocator& allocator);
 
+        // Map `count` consecutive pages to consecutive frames starting at `frame`. If a page
+        // table cannot be allocated, nothing stays mapped and false is returned.
+        template<typename Allocator>
+        bool map_range_to(Page start, memory::Frame frame, uint64_t count, PageFlags flags, Allocator& allocator);
+
+        // Map `count` consecutive pages (allocates the frames in batches). If physical memory
+        // runs out, nothing stays mapped, the frames are given back and false is returned.
+        template<typename Allocator>
+        bool map_range(Page start, uint64_t count, PageFlags flags, Allocator& allocator);
+
+        // Identity map `count` consecutive frames, false if a page table cannot be allocated
+        template<typename Allocator>
+        bool identity_map_range(memory::Frame start, uint64_t count, PageFlags flags, Allocator& allocator);
+
         // Unmap a page
         template<typename Allocator>
         void unmap(Page page, Allocator& allocator);
 
-        // Swaps the internal P4 table pointer between the active page and the
-        // given inactive one. After this operation,
-        // the active table will point to the previously inactive page table
-        // and the inactive one to the previously active one
-        void swap(InactivePageTable& inactive_page_table);
+        // Unmap `count` consecutive pages and invalidate the TLB once at the end. Without
+        // `free_frames` the frames stay with their owner, e.g. for device memory.
+        template<typename Allocator>
+        void unmap_range(Page start, uint64_t count, Allocator& allocator, bool free_frames = true);
+
+        // Map a 2 MiB page (page and frame must be 2 MiB aligned), false if a page table
+        // cannot be allocated
+        template<typename Allocator>
+        bool map_huge_2m(Page page, memory::Frame frame, PageFlags flags, Allocator& allocator);
+
+        // Map a 1 GiB page (page and frame must be 1 GiB aligned, needs CPU support), false
+        // if a page table cannot be allocated
+        template<typename Allocator>
+        bool map_huge_1g(Page page, memory::Frame frame, PageFlags flags, Allocator& allocator);
+
+        // Replace fully populated, physically contiguous tables with uniform flags inside
+        // the range by huge pages and return the freed tables to the allocator
+        template<typename Allocator>
+        void promote_range(Page start, uint64_t count, Allocator& allocator);
+
+        // Unmap everything below the kernel half and free the data frames and page tables
+        template<typename Allocator>
+        void unmap_user_half(Allocator& allocator);
 
-        template<typename F>
-        void with(InactivePageTable& table, TemporaryPage& temporary_page, F&& f);
+        // Whether the CPU supports 1 GiB pages
+        static bool supports_1g_pages();
 
         void print(VgaOutStream &stream, uint8_t recursive_level) const {
             p4_table->print(stream, recursive_level);
         }
 
     private:
-        ActivePageTable(): p4_table(reinterpret_cast<P4Table *>(RECURSIVE_P4_ADDR)) {}
+        /**
+         * The entries on the way down to the P1 table of a page. Every entry that points
+         * to a table counts the used entries of that table (Entry::used_entries), except
+         * for the P4 entries of the kernel half: every address space has its own copy of
+         * them, so the P3 tables of the kernel half are never freed.
+         */
+        struct Walk {
+            Entry* p4_entry;  // counts the used entries of the P3 table, nullptr in the kernel half
+            Entry* p3_entry;  // counts the used entries of the P2 table
+            Entry* p2_entry;  // counts the used entries of the P1 table
+            P3Table* p3;
+            P2Table* p2;
+            P1Table* p1;
+        };
+
         rnt::Optional<memory::Frame> translate_page(Page page);
-        static ActivePageTable instance_;
-        friend class TemporaryPage;
+
+        // Walk down to the P1 table of the page, creating missing tables on the way.
+        // p1 is nullptr if a table could not be allocated.
+        template<typename Allocator>
+        Walk walk_create(Page page, Allocator& allocator);
+
+        // The entry of the `level` table on the way to `page` was cleared. Tables that
+        // became empty are freed bottom up.
+        // @return Whether the table of the cleared entry was freed
+        template<typename Allocator>
+        bool release_entry(Page page, uint8_t level, Allocator& allocator);
+
+        // Walk down to the P1 table of the page, nullptr if it does not exist
+        P1Table* p1_table(Page page);
+
+        // Replace the huge page behind an entry by a table of next smaller pages, false if
+        // there is no frame for the table
+        template<typename Allocator>
+        bool split_huge_p3(P3Table* p3, uint16_t index, Page page, Allocator& allocator);
+        template<typename Allocator>
+        bool split_huge_p2(P2Table* p2, uint16_t index, Page page, Allocator& allocator);
     };
 
     /**
-     * The tiny allocator has control over exactly 3 frames that can be used
-     * by the TemporaryPage.
+     * The mapper of the page table that is currently loaded in CR3
      */
-    class TinyAllocator {
-        memory::Frame frames[3];
-        bool          available[3];
-
+    class ActivePageTable : public Mapper {
     public:
-        template<typename Allocator>
-        TinyAllocator(Allocator& allocator);
-        rnt::Optional<memory::Frame> allocate_frame();
-        void deallocate_frame(memory::Frame frame);
-    };
+        static ActivePageTable& instance();
 
-    class TemporaryPage {
-        Page page;
-        TinyAllocator allocator;
+        // Swaps the internal P4 table pointer between the active page and the
+        // given inactive one. After this operation,
+        // the active table will point to the previously inactive page table
+        // and the inactive one to the previously active one
+        void swap(InactivePageTable& inactive_page_table);
 
-        public:
-        template<typename Allocator>
-        TemporaryPage(Page page, Allocator& allocator);
-        VirtualAddress map(memory::Frame frame, ActivePageTable& active_table);
-        void unmap(ActivePageTable& active_table);
-        P1Table* map_table_frame(memory::Frame frame, ActivePageTable& active_page_table);
+    private:
+        ActivePageTable(): Mapper(nullptr) {}
+
+        static ActivePageTable instance_;
     };
 
     class InactivePageTable {
-        // frame which contains the inactive table
-        friend ActivePageTable;
-
         public:
         memory::Frame p4_frame;
-        explicit InactivePageTable(memory::Frame frame, ActivePageTable& active_table, TemporaryPage& temporary_page): p4_frame(frame) {
-            // Create a p4 table frame on the temporary page (temporary page is only used to access the frame)
-            auto table = temporary_page.map_table_frame(frame, active_table);
-            // Reset garbage value at that frame
-            table->clear();
-            // Make the p4 table recursive (with USER bit for ring 3 access)
-            table->get_entries()[RECURSIVE_INDEX].set(frame.start_address(), Entry::PRESENT | Entry::WRITABLE | Entry::USER);
-            // Unmap the temporary page, so it is free again. The p4_frame is still allocated by the original allocator.
-            temporary_page.unmap(active_table);
+        // tags the TLB entries of this address space
+        uint16_t pcid = tlb::KERNEL_PCID;
+
+        // Takes an allocated frame and clears it through the physmap, unless it is known to be zeroed
+        explicit InactivePageTable(memory::Frame frame, bool zeroed = false): p4_frame(frame) {
+            if (!zeroed) {
+                phys_to_virt<P4Table>(frame.start_address())->clear();
+            }
+        }
+
+        P4Table* p4() const {
+            return phys_to_virt<P4Table>(p4_frame.start_address());
+        }
+
+        // Edit the table without activating it
+        Mapper mapper() const {
+            return Mapper(p4());
         }
     };
 
@@ -0,0 +1,42 @@
+#ifndef MAIN_PHYSMAP_H
+#define MAIN_PHYSMAP_H
+
+#include <stdint.h>
+
+#include "panic.h"
+
+using PhysicalAddress = uint64_t;
+using VirtualAddress = uint64_t;
+
+/**
+ * Direct physical memory map
+ * All usable RAM is mapped linearly with huge pages at PHYSMAP_OFFSET, so the kernel
+ * can reach any frame (page tables in particular) without creating a mapping first.
+ */
+namespace paging {
+    // P4[384] maps 0xFFFFC00000000000 - 0xFFFFC07FFFFFFFFF (512 GiB)
+    constexpr uint16_t PHYSMAP_P4_INDEX = 384;
+    constexpr VirtualAddress PHYSMAP_OFFSET = 0xFFFF'C000'0000'0000ULL;
+    constexpr uint64_t PHYSMAP_SIZE = 512ULL * 1024 * 1024 * 1024;
+
+    inline VirtualAddress phys_to_virt(PhysicalAddress addr) {
+        return addr + PHYSMAP_OFFSET;
+    }
+
+    template<typename T>
+    inline T* phys_to_virt(PhysicalAddress addr) {
+        return reinterpret_cast<T*>(phys_to_virt(addr));
+    }
+
+    // Only valid for addresses inside the physmap, use ActivePageTable::translate for others
+    inline PhysicalAddress virt_to_phys(VirtualAddress addr) {
+        ASSERT(addr >= PHYSMAP_OFFSET && addr - PHYSMAP_OFFSET < PHYSMAP_SIZE, "Address is not in the physmap");
+        return addr - PHYSMAP_OFFSET;
+    }
+
+    inline PhysicalAddress virt_to_phys(const void* ptr) {
+        return virt_to_phys(reinterpret_cast<VirtualAddress>(ptr));
+    }
+}
+
+#endif //MAIN_PHYSMAP_H
@@ -0,0 +1,122 @@
+#include "tlb.h"
+#include "x86/cpuid.h"
+#include "x86/regs.h"
+
+namespace tlb {
+
+    static bool global_pages = false;
+    static bool pcids = false;
+    static bool invpcid = false;
+
+    // PCIDs handed out to address spaces
+    static uint64_t pcid_used[MAX_PCID / 64];
+    // PCIDs that may still have translations of a previous owner in the TLB
+    static uint64_t pcid_stale[MAX_PCID / 64];
+    // where the search for a free PCID starts
+    static uint16_t pcid_hint = KERNEL_PCID + 1;
+
+    // INVPCID invalidation types
+    enum InvpcidType : uint64_t {
+        SINGLE_CONTEXT = 1,
+        ALL_CONTEXTS_WITH_GLOBALS = 2,
+    };
+
+    static void invpcid_flush(InvpcidType type, uint16_t pcid) {
+        struct {
+            uint64_t pcid;
+            uint64_t address;
+        } descriptor = {pcid, 0};
+        asm volatile("invpcid %0, %1" : : "m"(descriptor), "r"(static_cast<uint64_t>(type)) : "memory");
+    }
+
+    void init() {
+        auto cr4_value = cr4::read();
+        if (cpuid::has_global_pages()) {
+            cr4_value |= cr4::PGE;
+            global_pages = true;
+        }
+        // PCIDE may only be set while CR3 holds PCID 0
+        if (cpuid::has_pcid() && cr3::get_pcid() == KERNEL_PCID) {
+            cr4_value |= cr4::PCIDE;
+            pcids = true;
+            invpcid = cpuid::has_invpcid();
+        }
+        cr4::write(cr4_value);
+        pcid_used[0] |= 1;  // KERNEL_PCID is never handed out
+    }
+
+    bool global_pages_enabled() {
+        return global_pages;
+    }
+
+    bool pcid_enabled() {
+        return pcids;
+    }
+
+    void flush_everything() {
+        if (invpcid) {
+            invpcid_flush(ALL_CONTEXTS_WITH_GLOBALS, 0);
+            return;
+        }
+        if (global_pages) {
+            // toggling PGE drops all translations of all PCIDs
+            auto value = cr4::read();
+            cr4::write(value & ~cr4::PGE);
+            cr4::write(value);
+            return;
+        }
+        flush_all();
+    }
+
+    void flush_pcid(uint16_t pcid) {
+        if (!pcids) {
+            // every switch flushes anyway
+            return;
+        }
+        if (invpcid) {
+            invpcid_flush(SINGLE_CONTEXT, pcid);
+            return;
+        }
+        pcid_stale[pcid / 64] |= 1ULL << (pcid % 64);
+    }
+
+    uint16_t allocate_pcid() {
+        if (!pcids) {
+            return KERNEL_PCID;
+        }
+        for (uint16_t i = 0; i < MAX_PCID; i++) {
+            uint16_t pcid = (pcid_hint + i) % MAX_PCID;
+            if (!(pcid_used[pcid / 64] & (1ULL << (pcid % 64)))) {
+                pcid_used[pcid / 64] |= 1ULL << (pcid % 64);
+                pcid_hint = pcid + 1;
+                return pcid;
+            }
+        }
+        // all in use: share PCID 0, which is flushed on every switch
+        return KERNEL_PCID;
+    }
+
+    void release_pcid(uint16_t pcid) {
+        if (pcid == KERNEL_PCID) {
+            return;
+        }
+        flush_pcid(pcid);
+        pcid_used[pcid / 64] &= ~(1ULL << (pcid % 64));
+    }
+
+    void switch_to(PhysicalAddress p4, uint16_t pcid) {
+        if (!pcids) {
+            cr3::set_phys_addr(p4);
+            return;
+        }
+
+        uint64_t value = (p4 & 0x000FFFFFFFFFF000ULL) | pcid;
+        auto stale = pcid_stale[pcid / 64] & (1ULL << (pcid % 64));
+        // PCID 0 may be shared by several address spaces, so it is always flushed
+        if (pcid != KERNEL_PCID && !stale) {
+            value |= cr3::NO_FLUSH;
+        }
+        pcid_stale[pcid / 64] &= ~(1ULL << (pcid % 64));
+        cr3::write(value);
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef MAIN_TLB_H
+#define MAIN_TLB_H
+
+#include <stdint.h>
+#include "cr3.h"
+
+/**
+ * TLB (Translation Lookaside Buffer) invalidation
+ *
+ * Kernel half mappings are global when the CPU supports it, so they survive
+ * address space switches. Every address space gets its own PCID when the CPU
+ * supports them, so switching CR3 does not throw away the TLB either.
+ */
+namespace tlb {
+    // Above this many pages a full flush is cheaper than invalidating page by page
+    constexpr uint64_t FULL_FLUSH_THRESHOLD = 32;
+
+    // PCID of the boot table and of address spaces that did not get an own PCID
+    constexpr uint16_t KERNEL_PCID = 0;
+    constexpr uint16_t MAX_PCID = 4096;
+
+    // Start of the kernel half, whose mappings are global
+    constexpr VirtualAddress KERNEL_HALF_START = 0xFFFF'8000'0000'0000ULL;
+
+    /**
+     * Detect and enable global pages and PCIDs. Must run while CR3 still uses PCID 0.
+     */
+    void init();
+
+    bool global_pages_enabled();
+    bool pcid_enabled();
+
+    /**
+     * Invalidate the translation of a single page in the current address space.
+     * Global translations of the page are invalidated as well.
+     */
+    inline void flush_page(VirtualAddress addr) {
+        asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+    }
+
+    /**
+     * Invalidate all non-global translations of the current address space
+     */
+    inline void flush_all() {
+        cr3::flush();
+    }
+
+    /**
+     * Invalidate every translation, including global ones and other PCIDs
+     */
+    void flush_everything();
+
+    /**
+     * Invalidate all translations tagged with the PCID of an address space that is
+     * not active. Without INVPCID this is deferred to the next switch to that PCID.
+     */
+    void flush_pcid(uint16_t pcid);
+
+    /**
+     * Invalidate the translations of `count` consecutive pages starting at `start`
+     */
+    inline void flush_range(VirtualAddress start, uint64_t count) {
+        if (count > FULL_FLUSH_THRESHOLD) {
+            // reloading CR3 keeps the global kernel translations
+            if (start >= KERNEL_HALF_START && global_pages_enabled()) {
+                flush_everything();
+            } else {
+                flush_all();
+            }
+            return;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            flush_page(start + i * memory::PAGE_SIZE);
+        }
+    }
+
+    /**
+     * Hand out a PCID for a new address space, KERNEL_PCID if PCIDs are unavailable or exhausted
+     */
+    uint16_t allocate_pcid();
+
+    /**
+     * Return the PCID of a destroyed address space, its translations are flushed
+     */
+    void release_pcid(uint16_t pcid);
+
+    /**
+     * Load CR3 with the given P4 table and PCID, keeping the TLB entries of the PCID
+     * if they are known to be valid
+     */
+    void switch_to(PhysicalAddress p4, uint16_t pcid);
+}
+
+#endif //MAIN_TLB_H
@@ -3,12 +3,47 @@
 //
 
 #include "panic.h"
+#include "syscall.h"
 #include "vga.hpp"
 
 // External VGA stream instance
 auto& out = vga::out();
 
+/**
+ * Code shared with user space (the heap allocators behind malloc) panics in ring 3, where
+ * cli and the VGA buffer fault. Report through the WRITE syscall and end the program.
+ */
+[[noreturn]] static void user_panic(const char* message, const char* file, int line) {
+    char digits[12];
+    int i = sizeof(digits) - 1;
+    digits[i] = '\0';
+    auto value = static_cast<unsigned>(line);
+    do {
+        digits[--i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0 && i > 0);
+
+    write(const_cast<char*>("PANIC in user space: "));
+    write(const_cast<char*>(message));
+    write(const_cast<char*>(" at "));
+    write(const_cast<char*>(file));
+    write(const_cast<char*>(":"));
+    write(&digits[i]);
+    write(const_cast<char*>("\n"));
+
+    // EXIT replaces the process, it does not come back
+    while (1) {
+        exit(1);
+    }
+}
+
 [[noreturn]] void panic(const char* message, const char* file, int line) {
+    uint16_t cs;
+    asm volatile("mov %%cs, %0" : "=r"(cs));
+    if ((cs & 3) == 3) {
+        user_panic(message, file, line);
+    }
+
     // Disable interrupts to prevent further execution
     asm volatile("cli");
 
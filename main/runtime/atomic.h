@@ -37,6 +37,10 @@ public:
     uint64_t load() const {
         return __atomic_load_n(&value, __ATOMIC_SEQ_CST);
     }
+
+    void store(uint64_t v) {
+        __atomic_store_n(&value, v, __ATOMIC_SEQ_CST);
+    }
 };
 
 #endif //MAIN_ATOMIC_H
\ No newline at end of file
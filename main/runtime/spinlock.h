@@ -0,0 +1,44 @@
+#ifndef MAIN_SPINLOCK_H
+#define MAIN_SPINLOCK_H
+#include <stdint.h>
+
+/**
+ * Test-and-test-and-set lock.
+ * Holders must not be interrupted by code that takes the same lock, so take it with
+ * interrupts disabled if it is also used from interrupt handlers.
+ */
+class SpinLock {
+    volatile uint32_t locked;
+public:
+    constexpr SpinLock(): locked(0) {}
+
+    void lock() {
+        while (__atomic_exchange_n(&locked, 1, __ATOMIC_ACQUIRE)) {
+            // wait on a plain load, so the cache line is not bounced between waiters
+            while (__atomic_load_n(&locked, __ATOMIC_RELAXED)) {
+                asm volatile("pause" ::: "memory");
+            }
+        }
+    }
+
+    void unlock() {
+        __atomic_store_n(&locked, 0, __ATOMIC_RELEASE);
+    }
+};
+
+class SpinLockGuard {
+    SpinLock& lock;
+public:
+    explicit SpinLockGuard(SpinLock& lock): lock(lock) {
+        lock.lock();
+    }
+
+    ~SpinLockGuard() {
+        lock.unlock();
+    }
+
+    SpinLockGuard(const SpinLockGuard&) = delete;
+    SpinLockGuard& operator=(const SpinLockGuard&) = delete;
+};
+
+#endif //MAIN_SPINLOCK_H
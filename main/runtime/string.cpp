@@ -0,0 +1,139 @@
+#include "string.h"
+#include "x86/cpuid.h"
+
+// All copies and fills use string instructions or inline assembly, so the compiler
+// cannot turn them back into calls to memcpy/memset.
+
+namespace rnt {
+    // Enhanced rep movsb/stosb (ERMS): byte string operations are the fastest at any size
+    static bool erms = false;
+    // Fast short rep movsb (FSRM): no startup overhead for short copies either
+    static bool fsrm = false;
+
+    // Below this size, rep movsb without FSRM loses against moving quadwords
+    constexpr size_t ERMS_THRESHOLD = 128;
+
+    void init_string() {
+        if (cpuid::max_basic_leaf() < 7) {
+            return;
+        }
+        auto features = cpuid::query(7, 0);
+        erms = features.ebx & (1u << 9);
+        fsrm = features.edx & (1u << 4);
+    }
+
+    static inline void rep_movsb(void* dst, const void* src, size_t n) {
+        asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+    }
+
+    static inline void rep_movsq(void* dst, const void* src, size_t n) {
+        asm volatile("rep movsq" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+    }
+
+    static inline void rep_stosb(void* dst, uint8_t value, size_t n) {
+        asm volatile("rep stosb" : "+D"(dst), "+c"(n) : "a"(value) : "memory");
+    }
+
+    static inline void rep_stosq(void* dst, uint64_t value, size_t n) {
+        asm volatile("rep stosq" : "+D"(dst), "+c"(n) : "a"(value) : "memory");
+    }
+
+    static inline void store_nt(uint64_t* dst, uint64_t value) {
+        asm volatile("movnti %1, %0" : "=m"(*dst) : "r"(value));
+    }
+
+    static inline void store_fence() {
+        asm volatile("sfence" : : : "memory");
+    }
+
+    static void copy_forward(void* dst, const void* src, size_t n) {
+        if (fsrm || (erms && n >= ERMS_THRESHOLD)) {
+            rep_movsb(dst, src, n);
+            return;
+        }
+        rep_movsq(dst, src, n / 8);
+        rep_movsb(static_cast<uint8_t*>(dst) + (n & ~7ULL), static_cast<const uint8_t*>(src) + (n & ~7ULL), n % 8);
+    }
+
+    static void fill(void* dst, uint64_t pattern, size_t n) {
+        if (fsrm || (erms && n >= ERMS_THRESHOLD)) {
+            rep_stosb(dst, pattern & 0xFF, n);
+            return;
+        }
+        rep_stosq(dst, pattern, n / 8);
+        rep_stosb(static_cast<uint8_t*>(dst) + (n & ~7ULL), pattern & 0xFF, n % 8);
+    }
+
+    void memcpy_nt(void* dst, const void* src, size_t n) {
+        auto d = static_cast<uint8_t*>(dst);
+        auto s = static_cast<const uint8_t*>(src);
+
+        // align the destination, movnti writes whole quadwords
+        size_t head = (8 - reinterpret_cast<uint64_t>(d) % 8) % 8;
+        if (head > n) head = n;
+        rep_movsb(d, s, head);
+        d += head;
+        s += head;
+        n -= head;
+
+        auto qd = reinterpret_cast<uint64_t*>(d);
+        auto qs = reinterpret_cast<const uint64_t*>(s);
+        size_t quads = n / 8;
+        for (size_t i = 0; i < quads; i++) {
+            uint64_t value;
+            asm volatile("mov %1, %0" : "=r"(value) : "m"(qs[i]));
+            store_nt(&qd[i], value);
+        }
+        rep_movsb(d + quads * 8, s + quads * 8, n % 8);
+
+        // make the streaming stores visible before anyone else touches the data
+        store_fence();
+    }
+
+    void memset32_nt(uint32_t* dst, uint32_t value, size_t count) {
+        if (count == 0) {
+            return;
+        }
+        if (reinterpret_cast<uint64_t>(dst) % 8 != 0) {
+            *dst++ = value;
+            count--;
+        }
+        auto pattern = (static_cast<uint64_t>(value) << 32) | value;
+        auto qd = reinterpret_cast<uint64_t*>(dst);
+        for (size_t i = 0; i < count / 2; i++) {
+            store_nt(&qd[i], pattern);
+        }
+        if (count % 2) {
+            dst[count - 1] = value;
+        }
+        store_fence();
+    }
+}
+
+extern "C" {
+    void* memcpy(void* dst, const void* src, size_t n) {
+        rnt::copy_forward(dst, src, n);
+        return dst;
+    }
+
+    void* memset(void* dst, int c, size_t n) {
+        uint64_t pattern = static_cast<uint8_t>(c) * 0x0101010101010101ULL;
+        rnt::fill(dst, pattern, n);
+        return dst;
+    }
+
+    void* memmove(void* dst, const void* src, size_t n) {
+        auto d = static_cast<uint8_t*>(dst);
+        auto s = static_cast<const uint8_t*>(src);
+        if (d <= s || d >= s + n) {
+            // no overlap that a forward copy would clobber
+            rnt::copy_forward(dst, src, n);
+            return dst;
+        }
+        // copy backwards, starting at the last byte
+        auto last_d = d + n - 1;
+        auto last_s = s + n - 1;
+        asm volatile("std\n\trep movsb\n\tcld" : "+D"(last_d), "+S"(last_s), "+c"(n) : : "memory");
+        return dst;
+    }
+}
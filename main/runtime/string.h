@@ -0,0 +1,34 @@
+#ifndef MAIN_STRING_H
+#define MAIN_STRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bulk memory primitives. The compiler may emit calls to these itself,
+// so they have to keep their C names and signatures.
+extern "C" {
+    void* memcpy(void* dst, const void* src, size_t n);
+    void* memset(void* dst, int c, size_t n);
+    void* memmove(void* dst, const void* src, size_t n);
+}
+
+namespace rnt {
+    /**
+     * Pick the fastest copy and fill strategy for this CPU.
+     * Until this has run, the portable rep movsq/stosq paths are used.
+     */
+    void init_string();
+
+    /**
+     * Copy with non-temporal stores that bypass the cache.
+     * For large transfers into memory that is not read back soon, like a framebuffer.
+     */
+    void memcpy_nt(void* dst, const void* src, size_t n);
+
+    /**
+     * Fill `count` 32-bit values with non-temporal stores
+     */
+    void memset32_nt(uint32_t* dst, uint32_t value, size_t count);
+}
+
+#endif //MAIN_STRING_H
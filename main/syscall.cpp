@@ -31,12 +31,12 @@ void write(char *c) {
     raw_syscall(WRITE, (uint64_t)c);
 }
 
-void *malloc(uint64_t size) {
-    return raw_syscall(MALLOC, size);
+void *sbrk(int64_t increment) {
+    return raw_syscall(SBRK, (uint64_t)increment);
 }
 
-void free(void *ptr) {
-    raw_syscall(FREE, (uint64_t)ptr);
+void heap_stats() {
+    raw_syscall(HEAP_STATS, 0);
 }
 
 void draw(uint32_t* buffer) {
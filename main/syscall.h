@@ -5,13 +5,22 @@
 #define MAIN_SYSCALL_H
 #include <stdint.h>
 
+// User heap window, the break starts at USER_HEAP_START and SBRK moves it within the window.
+// Shared by the kernel and the user-space allocator in malloc.cpp.
+constexpr uint64_t USER_HEAP_START = 0xB0000000;
+constexpr uint64_t USER_HEAP_SIZE = 8 * 1024 * 1024;   // 8MB heap
+// Only memory below the break is backed. The first page belongs to the heap from the start,
+// so the allocator can look for its state there before it has moved the break.
+constexpr uint64_t USER_HEAP_INITIAL_BREAK = USER_HEAP_START + 4096;
+
+// Returned by sbrk() when the break cannot be moved
+constexpr uint64_t SBRK_FAILED = UINT64_MAX;
+
 enum Syscall {
     NOOP = 0,
     WRITE_CHAR = 1,
     READ_CHAR = 2,
     WRITE = 3,
-    MALLOC = 4,
-    FREE = 5,
     CAN_READ_CHAR = 6,
     DRAW = 7,
     GET_SCREEN_WIDTH = 8,
@@ -23,6 +32,8 @@ enum Syscall {
     FB_SET_COLORS = 14,
     LIST_PROGRAMS = 15,
     RUN_PROGRAM = 16,
+    SBRK = 17,
+    HEAP_STATS = 18,
     EXIT = 60,
 };
 
@@ -44,9 +55,17 @@ char can_read_char();
 
 void write(char *c);
 
-void* malloc(uint64_t);
+/**
+ * Move the end of the heap (the break) by `increment` bytes
+ * @return The previous break, SBRK_FAILED if the break would leave the heap window
+ */
+void* sbrk(int64_t increment);
 
-void free(uint64_t);
+/**
+ * Print the kernel heap statistics (and its profile in HEAP_PROFILE builds) to the serial port,
+ * print_heap_stats() in malloc.h prints the heap of the process
+ */
+void heap_stats();
 
 void draw(uint32_t* buffer);
 
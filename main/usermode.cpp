@@ -1,5 +1,6 @@
 #include "usermode.h"
 #include "syscall.h"
+#include "malloc.h"
 #include "slides.h"
 #include "x86/regs.h"
 
@@ -1,5 +1,6 @@
 #include "vga.hpp"
 #include "ioutils.hpp"
+#include "runtime/string.h"
 
 // the global instance of the output stream
 VgaOutStream VgaOutStream::instance_;
@@ -187,13 +188,7 @@ void VgaOutStream::newline()
 void VgaOutStream::scroll()
 {
     // Shift rows 1..height-1 up to 0..height-2
-    for (int y = 1; y < height; ++y)
-    {
-        for (int x = 0; x < width * 2; ++x)
-        {
-            vgaBuffer[(y - 1) * (width * 2) + x] = vgaBuffer[y * (width * 2) + x];
-        }
-    }
+    memmove((void*)vgaBuffer, (const void*)(vgaBuffer + width * 2), (height - 1) * width * 2);
 
     // Clear last row (row height-1) with spaces and current attribute
     const int row_start = (height - 1) * (width * 2);
@@ -0,0 +1,57 @@
+#ifndef MAIN_CPU_H
+#define MAIN_CPU_H
+#include <stdint.h>
+
+namespace cpu {
+    // Upper bound for per-CPU data
+    constexpr uint8_t MAX_CPUS = 8;
+
+    // Interrupt flag in RFLAGS
+    constexpr uint64_t RFLAGS_IF = 1ULL << 9;
+
+    /**
+     * Index of the executing CPU into per-CPU data.
+     * Only the boot processor is started so far, once application processors run this
+     * has to be read from per-CPU state (GS base).
+     */
+    inline uint8_t current_id() {
+        return 0;
+    }
+
+    inline uint64_t read_rflags() {
+        uint64_t rflags;
+        asm volatile(
+            "pushfq\n\t"
+            "popq %0"
+            : "=r"(rflags)
+            :
+            : "memory"
+        );
+        return rflags;
+    }
+
+    /**
+     * Disables interrupts for its lifetime and restores the previous state afterwards,
+     * so it can be nested and used in interrupt handlers. Per-CPU data must only be
+     * touched under a guard, otherwise an interrupt handler could run in the middle of
+     * an update on the same CPU.
+     */
+    class InterruptGuard {
+        bool enabled;
+    public:
+        InterruptGuard(): enabled(read_rflags() & RFLAGS_IF) {
+            asm volatile("cli" ::: "memory");
+        }
+
+        ~InterruptGuard() {
+            if (enabled) {
+                asm volatile("sti" ::: "memory");
+            }
+        }
+
+        InterruptGuard(const InterruptGuard&) = delete;
+        InterruptGuard& operator=(const InterruptGuard&) = delete;
+    };
+}
+
+#endif //MAIN_CPU_H
@@ -0,0 +1,64 @@
+#ifndef MAIN_CPUID_H
+#define MAIN_CPUID_H
+#include <stdint.h>
+
+namespace cpuid {
+    struct Result {
+        uint32_t eax;
+        uint32_t ebx;
+        uint32_t ecx;
+        uint32_t edx;
+    };
+
+    // Execute CPUID for the given leaf (and subleaf)
+    inline Result query(uint32_t leaf, uint32_t subleaf = 0) {
+        Result r;
+        asm volatile(
+            "cpuid"
+            : "=a"(r.eax), "=b"(r.ebx), "=c"(r.ecx), "=d"(r.edx)
+            : "a"(leaf), "c"(subleaf)
+        );
+        return r;
+    }
+
+    inline uint32_t max_basic_leaf() {
+        return query(0).eax;
+    }
+
+    inline uint32_t max_extended_leaf() {
+        return query(0x80000000).eax;
+    }
+
+    // 1 GiB pages in the P3 table (CPUID.80000001H:EDX.Page1GB[bit 26])
+    inline bool has_1gb_pages() {
+        if (max_extended_leaf() < 0x80000001) {
+            return false;
+        }
+        return query(0x80000001).edx & (1u << 26);
+    }
+
+    // Global pages (CPUID.01H:EDX.PGE[bit 13])
+    inline bool has_global_pages() {
+        return query(1).edx & (1u << 13);
+    }
+
+    // Page attribute table (CPUID.01H:EDX.PAT[bit 16])
+    inline bool has_pat() {
+        return query(1).edx & (1u << 16);
+    }
+
+    // Process-context identifiers (CPUID.01H:ECX.PCID[bit 17])
+    inline bool has_pcid() {
+        return query(1).ecx & (1u << 17);
+    }
+
+    // The INVPCID instruction (CPUID.(EAX=07H,ECX=0H):EBX.INVPCID[bit 10])
+    inline bool has_invpcid() {
+        if (max_basic_leaf() < 7) {
+            return false;
+        }
+        return query(7, 0).ebx & (1u << 10);
+    }
+}
+
+#endif //MAIN_CPUID_H
@@ -5,9 +5,11 @@
 #ifndef MAIN_REGS_H
 #define MAIN_REGS_H
 #include <stdint.h>
+#include "cpuid.h"
 
 namespace msr {
     // Model-Specific Register addresses
+    constexpr uint32_t IA32_PAT = 0x277;
     constexpr uint32_t IA32_EFER = 0xC0000080;
 
     // Read MSR
@@ -52,6 +54,40 @@ namespace efer {
     }
 }
 
+namespace pat {
+    // Memory types of a PAT entry
+    constexpr uint64_t UC = 0x00;        // uncacheable
+    constexpr uint64_t WC = 0x01;        // write-combining
+    constexpr uint64_t WT = 0x04;        // write-through
+    constexpr uint64_t WB = 0x06;        // write-back
+    constexpr uint64_t UC_MINUS = 0x07;  // uncacheable, can be overridden by MTRR WC
+
+    // The entry that is reprogrammed to write-combining, selected by the PAT bit alone.
+    // Entries 0-3 keep their power-on values, so PWT/PCD mean the same as without PAT.
+    constexpr uint64_t WC_INDEX = 4;
+
+    inline uint64_t entry(uint64_t index, uint64_t type) {
+        return type << (index * 8);
+    }
+
+    // Whether init() found a PAT and programmed entry 4, write-combining is not available otherwise
+    inline bool enabled = false;
+
+    // Program entry 4 to write-combining, everything else keeps the power-on layout.
+    // CPUs without a PAT fault on the MSR, they are left alone.
+    inline void init() {
+        if (!cpuid::has_pat()) {
+            return;
+        }
+        uint64_t value = entry(0, WB) | entry(1, WT) | entry(2, UC_MINUS) | entry(3, UC)
+                       | entry(WC_INDEX, WC) | entry(5, WT) | entry(6, UC_MINUS) | entry(7, UC);
+        msr::write(msr::IA32_PAT, value);
+        // no mapping uses entry 4 yet, but caches may hold lines fetched under the old type
+        asm volatile("wbinvd" ::: "memory");
+        enabled = true;
+    }
+}
+
 namespace cr0 {
     // CR0 control register bits
     constexpr uint64_t WP = 1ULL << 16;  // Write Protect
@@ -73,6 +109,22 @@ namespace cr0 {
     }
 }
 
+namespace cr4 {
+    // CR4 control register bits
+    constexpr uint64_t PGE = 1ULL << 7;     // Page Global Enable
+    constexpr uint64_t PCIDE = 1ULL << 17;  // Process-Context Identifiers Enable
+
+    inline uint64_t read() {
+        uint64_t value;
+        asm volatile("mov %%cr4, %0" : "=r"(value));
+        return value;
+    }
+
+    inline void write(uint64_t value) {
+        asm volatile("mov %0, %%cr4" : : "r"(value) : "memory");
+    }
+}
+
 namespace cr2 {
     // Returns the Page Fault Linear Address
     inline uint64_t get_pfla() {